@@ -4,6 +4,10 @@
 #include <vector>
 #include <string>
 
+#include "device_info.hpp"
+
+// Every platform is listed before its devices are queried, so one without devices (or with a broken
+// driver) still shows up
 void platformInfo() {
     cl_uint numPlatforms = 0;
     if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS)
@@ -12,91 +16,38 @@ void platformInfo() {
     std::vector<cl_platform_id> platforms(numPlatforms);
     if (clGetPlatformIDs(numPlatforms, platforms.data(), NULL) != CL_SUCCESS)
         throw std::runtime_error("Can't get platforms");
-std::cout << "Platfroms:" << std::endl;
-    for (cl_uint i = 0; i < platforms.size(); i++) {
-        const size_t paramValueSize = 200;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetPlatformInfo(platforms[i], CL_PLATFORM_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get platforms info");
-        name[parValRetSize] = '\0';
-        std::cout << "\t" << std::string(name) << std::endl;
-    }
-    std::cout << "Devices:" << std::endl;
-    cl_uint numDevices = 0;
-    if (clGetDeviceIDs(platforms[0], CL_DEVICE_TYPE_CPU, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices == 1) {
-        cl_device_id device;
-        if (clGetDeviceIDs(platforms[0], CL_DEVICE_TYPE_CPU, numDevices, &device, NULL) != CL_SUCCESS)
-            throw std::runtime_error("Can't get device");
-        const size_t paramValueSize = 200;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetDeviceInfo(device, CL_DEVICE_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get number devices");
-        name[parValRetSize] = '\0';
-        std::cout << "\t" << std::string(name) << std::endl;
-    }
-    if (clGetDeviceIDs(platforms[0], CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices == 1) {
-        cl_device_id device;
-        if (clGetDeviceIDs(platforms[0], CL_DEVICE_TYPE_GPU, numDevices, &device, NULL) != CL_SUCCESS)
-            throw std::runtime_error("Can't get device");
-        const size_t paramValueSize = 200;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetDeviceInfo(device, CL_DEVICE_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get number devices");
-        name[parValRetSize] = '\0';
-        std::cout << "\t" << std::string(name) << std::endl;
-    }
-    if (clGetDeviceIDs(platforms[1], CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices == 1) {
-        cl_device_id device;
-        if (clGetDeviceIDs(platforms[1], CL_DEVICE_TYPE_GPU, numDevices, &device, NULL) != CL_SUCCESS)
-            throw std::runtime_error("Can't get device");
-        const size_t paramValueSize = 200;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetDeviceInfo(device, CL_DEVICE_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get number devices");
-        name[parValRetSize] = '\0';
-        std::cout << "\t" << std::string(name) << std::endl;
-    }
-}
 
-void print() {
-    cl_uint numPlatforms = 0;
-    if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number platforms");
-    std::vector<cl_platform_id> platforms(numPlatforms);
-    if (clGetPlatformIDs(numPlatforms, platforms.data(), NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get platforms");
-    cl_platform_id platform{};
-    for (cl_uint i = 0; i < platforms.size(); i++) {
-        const size_t paramValueSize = 200;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetPlatformInfo(platforms[i], CL_PLATFORM_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get platforms info");
-        name[parValRetSize] = '\0';
-        if (std::string(name) == "Intel(R) OpenCL") {
-            platform = platforms[i];
-            break;
+    std::cout << "Platforms:" << std::endl;
+    for (cl_uint i = 0; i < numPlatforms; i++) {
+        std::cout << getPlatformString(platforms[i], CL_PLATFORM_NAME) << std::endl;
+        cl_uint numDevices = 0;
+        cl_int retCode = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices);
+        if (retCode == CL_DEVICE_NOT_FOUND || (retCode == CL_SUCCESS && numDevices == 0)) {
+            std::cout << "\tno devices" << std::endl;
+            continue;
+        }
+        try {
+            if (retCode != CL_SUCCESS)
+                throw std::runtime_error("Can't get number devices");
+            std::vector<cl_device_id> devices(numDevices);
+            if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, numDevices, devices.data(), NULL) != CL_SUCCESS)
+                throw std::runtime_error("Can't get devices");
+            for (cl_uint j = 0; j < numDevices; j++) {
+                deviceInfo info;
+                queryDeviceInfo(platforms[i], devices[j], info);
+                printDeviceInfo(info);
+            }
+        } catch (const std::exception& e) {
+            std::cout << "\t" << e.what() << std::endl;
         }
     }
+}
 
-    cl_uint numDevices = 0;
-    if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices > 1)
-        throw std::runtime_error("Unsupport more than one device");
-    cl_device_id device;
-    if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, numDevices, &device, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get devices");
+void print() {
+    deviceInfo info;
+    selectDevice(CL_DEVICE_TYPE_GPU, info);
+    cl_platform_id platform = info.platform;
+    cl_device_id device = info.device;
     
     cl_context_properties contextProp[3]{ CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
     cl_int retCode = 0;
@@ -139,34 +90,10 @@ void print() {
 }
 
 void add() {
-    cl_uint numPlatforms = 0;
-    if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number platforms");
-    std::vector<cl_platform_id> platforms(numPlatforms);
-    if (clGetPlatformIDs(numPlatforms, platforms.data(), NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get platforms");
-    cl_platform_id platform{};
-    for (cl_uint i = 0; i < platforms.size(); i++) {
-        const size_t paramValueSize = 200;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetPlatformInfo(platforms[i], CL_PLATFORM_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get platforms info");
-        name[parValRetSize] = '\0';
-        if (std::string(name) == "Intel(R) OpenCL") {
-            platform = platforms[i];
-            break;
-        }
-    }
-
-    cl_uint numDevices = 0;
-    if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices > 1)
-        throw std::runtime_error("Unsupport more than one device");
-    cl_device_id device;
-    if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, numDevices, &device, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get devices");
+    deviceInfo info;
+    selectDevice(CL_DEVICE_TYPE_GPU, info);
+    cl_platform_id platform = info.platform;
+    cl_device_id device = info.device;
 
     cl_context_properties contextProp[3]{ CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
     cl_int retCode = 0;
@@ -1,13 +1,120 @@
+// Size and strides baked in by the specialization cache (jit_cache.hpp), otherwise the runtime arguments.
+// SPEC_EXACT means the launch covers exactly n elements, so the bounds checks go away.
+#ifdef SPEC_N
+#define N SPEC_N
+#else
+#define N n
+#endif
+#ifdef SPEC_INCX
+#define INCX SPEC_INCX
+#else
+#define INCX incx
+#endif
+#ifdef SPEC_INCY
+#define INCY SPEC_INCY
+#else
+#define INCY incy
+#endif
+
 __kernel void saxpy(const int n, const float a, __global float* x, const int incx, __global float* y, const int incy) {
     int id = get_global_id(0);
 
-    if (id < n && id * incx < n && id * incy < n)
-        y[id * incy] += a * x[id * incx];
+#ifndef SPEC_EXACT
+    if (id < N && id * INCX < N && id * INCY < N)
+#endif
+        y[id * INCY] += a * x[id * INCX];
 }
 
+#ifdef USE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
 __kernel void daxpy(const int n, const double a, __global double* x, const int incx, __global double* y, const int incy) {
     int id = get_global_id(0);
 
-    if (id < n && id * incx < n && id * incy < n)
-        y[id * incy] += a * x[id * incx];
-}
\ No newline at end of file
+#ifndef SPEC_EXACT
+    if (id < N && id * INCX < N && id * INCY < N)
+#endif
+        y[id * INCY] += a * x[id * INCX];
+}
+#endif
+
+// Unit stride variants, VEC_WIDTH (2, 4, 8 or 16) elements per work-item, incx/incy are ignored
+#ifdef VEC_WIDTH
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+#define VLOAD CAT(vload, VEC_WIDTH)
+#define VSTORE CAT(vstore, VEC_WIDTH)
+
+__kernel void saxpyVec(const int n, const float a, __global float* x, const int incx, __global float* y, const int incy) {
+    int id = get_global_id(0);
+    int base = id * VEC_WIDTH;
+
+#ifndef SPEC_EXACT
+    if (base + VEC_WIDTH > N) {
+        for (int i = base; i < N; i++)
+            y[i] += a * x[i];
+        return;
+    }
+#endif
+    VSTORE(VLOAD(id, y) + a * VLOAD(id, x), id, y);
+}
+
+#ifdef USE_FP64
+__kernel void daxpyVec(const int n, const double a, __global double* x, const int incx, __global double* y, const int incy) {
+    int id = get_global_id(0);
+    int base = id * VEC_WIDTH;
+
+#ifndef SPEC_EXACT
+    if (base + VEC_WIDTH > N) {
+        for (int i = base; i < N; i++)
+            y[i] += a * x[i];
+        return;
+    }
+#endif
+    VSTORE(VLOAD(id, y) + a * VLOAD(id, x), id, y);
+}
+#endif
+#endif
+
+// Philox4x32-10, mirrors rng::philox4x32 in random_utils.hpp (one work-item per counter block)
+#pragma OPENCL FP_CONTRACT OFF
+
+uint4 philox4x32(uint4 ctr, uint2 key) {
+    for (int round = 0; round < 10; round++) {
+        uint hi0 = mul_hi(0xD2511F53u, ctr.x);
+        uint lo0 = 0xD2511F53u * ctr.x;
+        uint hi1 = mul_hi(0xCD9E8D57u, ctr.z);
+        uint lo1 = 0xCD9E8D57u * ctr.z;
+        ctr = (uint4)(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+        key += (uint2)(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return ctr;
+}
+
+__kernel void philoxUniformFloat(__global float* out, const int n, const uint seedLo, const uint seedHi, const float lo, const float hi) {
+    uint block = get_global_id(0);
+    uint4 r = philox4x32((uint4)(block, 0, 0, 0), (uint2)(seedLo, seedHi));
+    uint r4[4] = { r.x, r.y, r.z, r.w };
+
+    for (int lane = 0; lane < 4; lane++) {
+        int idx = block * 4 + lane;
+        if (idx < n)
+            out[idx] = lo + (hi - lo) * ((float)(r4[lane] >> 8) * (1.0f / 16777216.0f));
+    }
+}
+
+#ifdef USE_FP64
+__kernel void philoxUniformDouble(__global double* out, const int n, const uint seedLo, const uint seedHi, const double lo, const double hi) {
+    uint block = get_global_id(0);
+    uint4 r = philox4x32((uint4)(block, 0, 0, 0), (uint2)(seedLo, seedHi));
+    uint r4[4] = { r.x, r.y, r.z, r.w };
+
+    for (int lane = 0; lane < 2; lane++) {
+        int idx = block * 2 + lane;
+        if (idx < n) {
+            double u = ((double)(r4[2 * lane] >> 5) * 67108864.0 + (double)(r4[2 * lane + 1] >> 6)) * (1.0 / 9007199254740992.0);
+            out[idx] = lo + (hi - lo) * u;
+        }
+    }
+}
+#endif
@@ -2,6 +2,8 @@
 
 #include <omp.h>
 
+#include "task_pool.hpp"
+
 namespace host {
 
 template <typename dataType>
@@ -46,4 +48,24 @@ void daxpy(const int& n, const double& a, const double* x, const int& incx, doub
     }
 }
 
+// 32K elements per task keep the x and y chunks of one task in L2
+const size_t AXPY_CHUNK = 1 << 15;
+
+// Chunks of the AXPY as tasks of the work-stealing pool, same elements as axpy
+template <typename dataType>
+void axpyTasks(const int& n, const dataType& a, const dataType* x, const int& incx, dataType* y, const int& incy) {
+    const size_t step = static_cast<size_t>(std::max(incx, incy));
+    const size_t workAmount = n > 0 ? (static_cast<size_t>(n) + step - 1) / step : 0;
+    parallelChunks(hostTaskPool(), workAmount, AXPY_CHUNK, [&](size_t begin, size_t end) {
+        if (incx == 1 && incy == 1) {
+#pragma omp simd
+            for (size_t i = begin; i < end; i++)
+                y[i] += a * x[i];
+        } else {
+            for (size_t i = begin; i < end; i++)
+                y[i * incy] += a * x[i * incx];
+        }
+    });
+}
+
 }
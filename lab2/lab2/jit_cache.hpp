@@ -0,0 +1,99 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "program_cache.hpp"
+
+// Shape specialization: once a (kernel, shape) pair recurs, the kernel is rebuilt with the shape and strides
+// baked in as SPEC_* defines, so the compiler can unroll loops and fold index math. Programs belong to a
+// context, so entries are keyed by context as well as device.
+
+typedef std::vector<std::pair<std::string, long long>> specializationDefines;
+
+struct specializationKey {
+    std::string kernelName;
+    std::string options;
+    specializationDefines defines;
+    cl_context context{};
+    cl_device_id device{};
+
+    bool operator<(const specializationKey& other) const {
+        if (kernelName != other.kernelName)
+            return kernelName < other.kernelName;
+        if (options != other.options)
+            return options < other.options;
+        if (defines != other.defines)
+            return defines < other.defines;
+        if (context != other.context)
+            return context < other.context;
+        return device < other.device;
+    }
+};
+
+struct specializationEntry {
+    cl_program program{};
+    cl_kernel kernel{};
+    size_t uses = 0;
+    bool failed = false;
+};
+
+struct specializationCache {
+    std::map<specializationKey, specializationEntry> entries;
+    size_t threshold = 2;
+    size_t hits = 0;
+    size_t builds = 0;
+};
+
+std::string specializationOptions(const std::string& options, const specializationDefines& defines) {
+    std::string result = options;
+    for (size_t i = 0; i < defines.size(); i++)
+        result += " -D" + defines[i].first + "=" + std::to_string(defines[i].second);
+    return result;
+}
+
+// Returns the specialized kernel from the shape's threshold-th use on, the generic kernel before that or if the build failed
+cl_kernel getSpecializedKernel(specializationCache& cache, const cl_context& context, const cl_device_id& device,
+                               const std::vector<char>& kernelText, const std::string& kernelName, const std::string& options,
+                               const specializationDefines& defines, const cl_kernel& generic) {
+    specializationKey key{ kernelName, options, defines, context, device };
+    specializationEntry& entry = cache.entries[key];
+    entry.uses++;
+    if (entry.kernel != nullptr) {
+        cache.hits++;
+        return entry.kernel;
+    }
+    if (entry.failed || entry.uses < cache.threshold)
+        return generic;
+
+    try {
+        buildProgram(context, device, kernelText, specializationOptions(options, defines), entry.program);
+        cl_int retCode;
+        entry.kernel = clCreateKernel(entry.program, kernelName.c_str(), &retCode);
+    } catch (const std::exception&) {
+        entry.program = nullptr;
+    }
+    if (entry.kernel == nullptr) {
+        if (entry.program != nullptr)
+            clReleaseProgram(entry.program);
+        entry.program = nullptr;
+        entry.failed = true;
+        return generic;
+    }
+    cache.builds++;
+    return entry.kernel;
+}
+
+void releaseSpecializationCache(specializationCache& cache) {
+    for (std::map<specializationKey, specializationEntry>::iterator it = cache.entries.begin(); it != cache.entries.end(); ++it) {
+        if (it->second.kernel != nullptr)
+            clReleaseKernel(it->second.kernel);
+        if (it->second.program != nullptr)
+            clReleaseProgram(it->second.program);
+    }
+    cache.entries.clear();
+}
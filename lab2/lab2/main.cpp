@@ -1,76 +1,264 @@
 #include <iostream>
 #include <vector>
-#include <random>
 #include <ctime>
 #include <omp.h>
 #include <iomanip>
+#include <climits>
+#include <functional>
 
 #include "axpy_host.hpp"
 #include "opencl_utils.hpp"
+#include "npy_utils.hpp"
+#include "jit_cache.hpp"
+#include "perf_counters.hpp"
+#include "roofline.hpp"
+#include "results_store.hpp"
+#include "primitives.hpp"
+#include "primitives_host.hpp"
 
 template <typename dataType>
-std::vector<dataType> getVector(const int& size) {
+std::vector<dataType> getVector(const int& size, const uint64_t& seed) {
     std::vector<dataType> resVector(size);
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<dataType> dist(-100, 100);
-
-    for (size_t i = 0; i < resVector.size(); i++)
-        resVector[i] = dist(gen);
+    rng::fillUniform(resVector.data(), 0, resVector.size(), seed, dataType(-100), dataType(100));
 
     return resVector;
 }
 
+// Running max |ref - res| of a result verified chunk by chunk, printed like compare
+struct chunkDiff {
+    double diff = -1.0;
+    double refVal{};
+    double resVal{};
+    size_t idx{};
+};
+
+template <typename dataType>
+void updateDiff(chunkDiff& d, const dataType* ref, const dataType* res, const size_t offset, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const double diff = std::abs(static_cast<double>(ref[i]) - static_cast<double>(res[i]));
+        if (diff > d.diff) {
+            d.diff = diff;
+            d.refVal = ref[i];
+            d.resVal = res[i];
+            d.idx = offset + i;
+        }
+    }
+}
+
+void printDiff(const chunkDiff& d) {
+    std::cout << "Max difference is: " << d.diff << " on ref: " << d.refVal << " and res: " << d.resVal << " on idx: " << d.idx << std::endl;
+}
+
+// y[offset, offset + count) after the AXPY, rebuilt from the seeds into y; x is scratch of the same size.
+// Strided x elements are generated one by one.
+template <typename dataType>
+void referenceChunk(const int& n, const int& incx, const int& incy, const dataType& a, const uint64_t& seedX, const uint64_t& seedY,
+                    const size_t offset, const size_t count, dataType* x, dataType* y) {
+    rng::fillUniform(y, offset, count, seedY, dataType(-100), dataType(100));
+    if (incx == 1 && incy == 1) {
+        rng::fillUniform(x, offset, count, seedX, dataType(-100), dataType(100));
+        for (size_t i = 0; i < count; i++)
+            y[i] += a * x[i];
+        return;
+    }
+    for (size_t j = offset; j < offset + count; j++) {
+        const size_t i = j / incy;
+        if (j % incy == 0 && i * incx < static_cast<size_t>(n))
+            y[j - offset] += a * rng::uniformAt(i * incx, seedX, dataType(-100), dataType(100));
+    }
+}
+
+// Compares the n elements delivered by read(offset, count, dst) against the reference, chunk elements at a
+// time, so only two chunks and the scratch x are resident
+template <typename dataType>
+void verifyChunked(const int& n, const int& incx, const int& incy, const dataType& a, const uint64_t& seedX, const uint64_t& seedY,
+                   const size_t chunk, const std::function<void(size_t, size_t, dataType*)>& read) {
+    std::vector<dataType> x(chunk), ref(chunk), res(chunk);
+    chunkDiff d;
+    for (size_t offset = 0; offset < static_cast<size_t>(n); offset += chunk) {
+        const size_t count = std::min(chunk, static_cast<size_t>(n) - offset);
+        referenceChunk<dataType>(n, incx, incy, a, seedX, seedY, offset, count, x.data(), ref.data());
+        read(offset, count, res.data());
+        updateDiff(d, ref.data(), res.data(), offset, count);
+    }
+    printDiff(d);
+}
+
+// x and y are generated on the device from the same seeds as getVector, so nothing is uploaded.
+// With verifyChunk y is checked against the reference chunk by chunk and result stays empty.
+// Returns the kernel time in seconds.
 template <typename dataType>
-void computeOnDevice(const int& n, const int& incx, const int& incy, const std::vector<dataType>& srcVector, const dataType& a,
-                     const cl_device_type deviceType, const cl_platform_id& platform, const std::vector<char>& kernelText,
-                     const size_t& localWorkSize, std::vector<dataType>& result) {
-    cl_device_id device{};
-    getDevice(platform, deviceType, device);
+double computeOnDevice(const int& n, const int& incx, const int& incy, const uint64_t& seedX, const uint64_t& seedY, const dataType& a,
+                     const cl_device_type deviceType, const std::vector<char>& kernelText,
+                     const size_t& localWorkSize, std::vector<dataType>& result, const size_t verifyChunk = 0) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    cl_device_id device = info.device;
     cl_context context{};
-    createContext(platform, device, context);
+    createContext(info.platform, device, context);
     cl_command_queue queue{};
     createQueue(context, device, queue);
     cl_program program{};
     cl_kernel kernel{};
+    cl_kernel generator{};
 
+    axpyLaunch launch = selectAxpyLaunch<dataType>(info, n, incx, incy, localWorkSize);
+    createProgramAndKernel(context, device, program, kernel, launch.kernelName, launch.options);
     if (std::is_same<dataType, float>::value)
-        createProgramAndKernel(context, device, program, kernel, "saxpy");
+        createKernel(program, generator, "philoxUniformFloat");
     else if (std::is_same<dataType, double>::value)
-        createProgramAndKernel(context, device, program, kernel, "daxpy");
+        createKernel(program, generator, "philoxUniformDouble");
     else
         throw std::runtime_error("Unsupported data type to execute");
 
     cl_mem x{}, y{};
     createMemoryObject(context, x, y, n, sizeof(dataType));
-    writeToBuffer(queue, x, srcVector.data(), n, sizeof(dataType));
-    writeToBuffer(queue, y, result.data(), n, sizeof(dataType));
+    generateOnDevice<dataType>(queue, generator, x, n, seedX, dataType(-100), dataType(100));
+    generateOnDevice<dataType>(queue, generator, y, n, seedY, dataType(-100), dataType(100));
+    if (clFinish(queue) != CL_SUCCESS)
+        throw std::runtime_error("Can't generate input data");
     setArguments<dataType>(kernel, n, a, x, incx, y, incy);
 
-    size_t maxLocWorkGroup{};
-    if (clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxLocWorkGroup, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get kernel work group info");
-    std::cout << "Max kernel work group size: " << maxLocWorkGroup << std::endl;
+    const size_t globalWorkSize = finishAxpyLaunch(kernel, device, launch);
+    std::cout << info.name << ": " << launch.kernelName << " (" << launch.options << ")" << std::endl;
 
     std::string deviceName = deviceType == CL_DEVICE_TYPE_GPU ? "GPU" : "CPU";
     double start = omp_get_wtime();
-    execute(queue, kernel, n, localWorkSize);
+    execute(queue, kernel, globalWorkSize, launch.localWorkSize);
     cl_int ret = clFinish(queue);
     double end = omp_get_wtime();
-    std::cout << "OpenCL " << deviceName << " with group size: " << localWorkSize
+    std::cout << "OpenCL " << deviceName << " with group size: " << launch.localWorkSize
         << " has time: " << end - start << " sec" << std::endl;
 
-    if (clEnqueueReadBuffer(queue, y, CL_TRUE, 0, sizeof(dataType) * n, result.data(), 0, NULL, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't write to buffer");
+    if (verifyChunk > 0) {
+        verifyChunked<dataType>(n, incx, incy, a, seedX, seedY, verifyChunk, [&](size_t offset, size_t count, dataType* dst) {
+            if (clEnqueueReadBuffer(queue, y, CL_TRUE, sizeof(dataType) * offset, sizeof(dataType) * count, dst, 0, NULL, NULL) != CL_SUCCESS)
+                throw std::runtime_error("Can't read from buffer");
+        });
+    } else {
+        result.resize(n);
+        if (clEnqueueReadBuffer(queue, y, CL_TRUE, 0, sizeof(dataType) * n, result.data(), 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't write to buffer");
+    }
 
     clReleaseMemObject(x);
     clReleaseMemObject(y);
     clReleaseProgram(program);
     clReleaseKernel(kernel);
+    clReleaseKernel(generator);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    return end - start;
+}
+
+// x and y are wrapped as CL_MEM_USE_HOST_PTR buffers (e.g. npy mappings), y is updated in place
+template <typename dataType>
+void computeOnHostPtr(const int& n, const int& incx, const int& incy, const dataType* x, dataType* y, const dataType& a,
+                      const cl_device_type deviceType, const size_t& localWorkSize) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    cl_program program{};
+    cl_kernel kernel{};
+    axpyLaunch launch = selectAxpyLaunch<dataType>(info, n, incx, incy, localWorkSize);
+    createProgramAndKernel(context, device, program, kernel, launch.kernelName, launch.options);
+
+    cl_int retCode;
+    cl_mem xBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(dataType) * n, const_cast<dataType*>(x), &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create input buffer from host ptr");
+    cl_mem yBuf = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(dataType) * n, y, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create output buffer from host ptr");
+    setArguments<dataType>(kernel, n, a, xBuf, incx, yBuf, incy);
+
+    std::string deviceName = deviceType == CL_DEVICE_TYPE_GPU ? "GPU" : "CPU";
+    const size_t globalWorkSize = finishAxpyLaunch(kernel, device, launch);
+    double start = omp_get_wtime();
+    execute(queue, kernel, globalWorkSize, launch.localWorkSize);
+    clFinish(queue);
+    double end = omp_get_wtime();
+    std::cout << "OpenCL " << deviceName << " on host ptr has time: " << end - start << " sec" << std::endl;
+
+    // mapping makes the device copy (if the driver made one) visible through y
+    void* mapped = clEnqueueMapBuffer(queue, yBuf, CL_TRUE, CL_MAP_READ, 0, sizeof(dataType) * n, 0, NULL, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't map output buffer");
+    if (clEnqueueUnmapMemObject(queue, yBuf, mapped, 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't unmap output buffer");
+    clFinish(queue);
+
+    clReleaseMemObject(xBuf);
+    clReleaseMemObject(yBuf);
+    clReleaseProgram(program);
+    clReleaseKernel(kernel);
     clReleaseCommandQueue(queue);
     clReleaseContext(context);
 }
 
+template <typename dataType>
+void computeNpy(const npyArray& x, npyArray& out, const dataType& a, const std::string& backend) {
+    const size_t size = npyElements(x);
+    if (size > INT_MAX)
+        throw std::runtime_error("Too large vector for axpy");
+    const int n = static_cast<int>(size);
+    const dataType* xData = npyData<dataType>(x);
+    dataType* yData = npyData<dataType>(out);
+
+    if (backend == "omp") {
+        double start = omp_get_wtime();
+        if (std::is_same<dataType, float>::value)
+            host::saxpy(n, static_cast<float>(a), reinterpret_cast<const float*>(xData), 1, reinterpret_cast<float*>(yData), 1);
+        else
+            host::daxpy(n, static_cast<double>(a), reinterpret_cast<const double*>(xData), 1, reinterpret_cast<double*>(yData), 1);
+        double end = omp_get_wtime();
+        std::cout << "OpenMP time: " << end - start << " sec" << std::endl;
+    } else if (backend == "gpu" || backend == "cpu") {
+        computeOnHostPtr<dataType>(n, 1, 1, xData, yData, a, backend == "gpu" ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, 0);
+    } else {
+        throw std::runtime_error("Unknown backend " + backend);
+    }
+}
+
+// lab2 <x.npy> <y.npy> <out.npy> [a] [gpu|cpu|omp]: out = a * x + y, all files memory mapped
+int runNpy(int argc, char* argv[]) {
+    try {
+        npyArray x, y, out;
+        openNpy(argv[1], x);
+        openNpy(argv[2], y);
+        if (x.descr != y.descr || npyElements(x) != npyElements(y))
+            throw std::runtime_error("x and y have different type or size");
+        const double a = argc > 4 ? std::stod(argv[4]) : 0.2;
+        const std::string backend = argc > 5 ? argv[5] : "gpu";
+
+        // axpy works in place, so y is copied once into the output mapping
+        if (x.descr == npyDescr<float>()) {
+            createNpy<float>(argv[3], y.shape, out);
+            memcpy(npyData<float>(out), npyData<float>(y), npyElements(y) * sizeof(float));
+            closeNpy(y);
+            computeNpy<float>(x, out, static_cast<float>(a), backend);
+        } else if (x.descr == npyDescr<double>()) {
+            createNpy<double>(argv[3], y.shape, out);
+            memcpy(npyData<double>(out), npyData<double>(y), npyElements(y) * sizeof(double));
+            closeNpy(y);
+            computeNpy<double>(x, out, a, backend);
+        } else {
+            throw std::runtime_error("Unsupported npy type " + x.descr);
+        }
+        closeNpy(x);
+        closeNpy(out);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
 template <typename dataType>
 void compare(const std::vector<dataType>& ref, const std::vector<dataType>& res) {
     if (ref.size() != res.size())
@@ -90,52 +278,595 @@ void compare(const std::vector<dataType>& ref, const std::vector<dataType>& res)
     std::cout << "Max difference is: " << diff << " on ref: " << refVal << " and res: " << resVal << " on idx: " << idx << std::endl;
 }
 
-int main() {
+struct subDeviceJob {
+    deviceInfo info;
+    cl_context context{};
+    cl_command_queue queue{};
+    cl_program program{};
+    cl_kernel kernel{};
+    cl_kernel generator{};
+    cl_mem x{}, y{};
+    axpyLaunch launch;
+    size_t globalWorkSize{};
+};
+
+// One AXPY job per CPU sub-device, each in its own context and queue, all running at the same time.
+// Inputs are generated by the sub-device itself into CL_MEM_ALLOC_HOST_PTR buffers, so their pages are
+// first touched by the threads the runtime pinned to that partition.
+template <typename dataType>
+void computeOnSubDevices(const int& n, const dataType& a, const std::string& partition, const uint64_t& seed) {
+    deviceInfo cpu;
+    selectDevice(CL_DEVICE_TYPE_CPU, cpu);
+    partitionType pt{};
+    std::vector<cl_uint> counts;
+    parsePartition(partition, pt, counts);
+    std::vector<cl_device_id> subDevices;
+    createSubDevices(cpu.device, pt, counts, subDevices);
+    std::cout << cpu.name << " partitioned into " << subDevices.size() << " sub devices" << std::endl;
+
+    std::vector<subDeviceJob> jobs(subDevices.size());
+    for (size_t j = 0; j < jobs.size(); j++) {
+        subDeviceJob& job = jobs[j];
+        queryDeviceInfo(cpu.platform, subDevices[j], job.info);
+        createContext(cpu.platform, subDevices[j], job.context);
+        createQueue(job.context, subDevices[j], job.queue);
+        job.launch = selectAxpyLaunch<dataType>(job.info, n, 1, 1, 0);
+        createProgramAndKernel(job.context, subDevices[j], job.program, job.kernel, job.launch.kernelName, job.launch.options);
+        createKernel(job.program, job.generator, std::is_same<dataType, float>::value ? "philoxUniformFloat" : "philoxUniformDouble");
+
+        cl_int retCode;
+        job.x = clCreateBuffer(job.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(dataType) * n, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create input buffer");
+        job.y = clCreateBuffer(job.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(dataType) * n, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create output buffer");
+        generateOnDevice<dataType>(job.queue, job.generator, job.x, n, seed + 2 * j, dataType(-100), dataType(100));
+        generateOnDevice<dataType>(job.queue, job.generator, job.y, n, seed + 2 * j + 1, dataType(-100), dataType(100));
+        setArguments<dataType>(job.kernel, n, a, job.x, 1, job.y, 1);
+        job.globalWorkSize = finishAxpyLaunch(job.kernel, subDevices[j], job.launch);
+    }
+    for (size_t j = 0; j < jobs.size(); j++)
+        clFinish(jobs[j].queue);
+
+    double start = omp_get_wtime();
+    for (size_t j = 0; j < jobs.size(); j++) {
+        execute(jobs[j].queue, jobs[j].kernel, jobs[j].globalWorkSize, jobs[j].launch.localWorkSize);
+        clFlush(jobs[j].queue);
+    }
+    for (size_t j = 0; j < jobs.size(); j++)
+        clFinish(jobs[j].queue);
+    double end = omp_get_wtime();
+    std::cout << jobs.size() << " concurrent jobs of " << n << " elements have time: " << end - start << " sec" << std::endl;
+
+    std::vector<dataType> x(n), y(n), result(n);
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (clEnqueueReadBuffer(jobs[j].queue, jobs[j].y, CL_TRUE, 0, sizeof(dataType) * n, result.data(), 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't read from buffer");
+        rng::fillUniform(x.data(), 0, x.size(), seed + 2 * j, dataType(-100), dataType(100));
+        rng::fillUniform(y.data(), 0, y.size(), seed + 2 * j + 1, dataType(-100), dataType(100));
+        host::axpy<dataType>(n, a, x.data(), 1, y.data(), 1);
+        std::cout << "Job " << j << ": ";
+        compare<dataType>(y, result);
+    }
+
+    for (size_t j = 0; j < jobs.size(); j++) {
+        clReleaseMemObject(jobs[j].x);
+        clReleaseMemObject(jobs[j].y);
+        clReleaseKernel(jobs[j].kernel);
+        clReleaseKernel(jobs[j].generator);
+        clReleaseProgram(jobs[j].program);
+        clReleaseCommandQueue(jobs[j].queue);
+        clReleaseContext(jobs[j].context);
+    }
+    releaseSubDevices(subDevices);
+}
+
+// Repeats AXPY over a few sizes in one context; from the second use on, a size runs a kernel built with it baked in
+template <typename dataType>
+void computeRepeated(const cl_device_type deviceType, const std::vector<int>& sizes, const size_t repeats, const dataType& a,
+                     const uint64_t& seedX, const uint64_t& seedY) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    std::vector<char> kernelText;
+    getKernelText(kernelText);
+
+    const int maxSize = *std::max_element(sizes.begin(), sizes.end());
+    cl_program program{};
+    cl_kernel generic{};
+    cl_kernel generator{};
+    const axpyLaunch genericLaunch = selectAxpyLaunch<dataType>(info, maxSize, 1, 1, 0);
+    createProgramAndKernel(context, device, program, generic, genericLaunch.kernelName, genericLaunch.options);
+    createKernel(program, generator, std::is_same<dataType, float>::value ? "philoxUniformFloat" : "philoxUniformDouble");
+    cl_mem x{}, y{};
+    createMemoryObject(context, x, y, maxSize, sizeof(dataType));
+    generateOnDevice<dataType>(queue, generator, x, maxSize, seedX, dataType(-100), dataType(100));
+    generateOnDevice<dataType>(queue, generator, y, maxSize, seedY, dataType(-100), dataType(100));
+    clFinish(queue);
+
+    specializationCache cache;
+    for (size_t r = 0; r <= repeats; r++) {
+        // the last pass starts from fresh y and is checked against the host
+        if (r == repeats) {
+            generateOnDevice<dataType>(queue, generator, y, maxSize, seedY, dataType(-100), dataType(100));
+            clFinish(queue);
+        }
+        double start = omp_get_wtime();
+        for (size_t s = 0; s < sizes.size(); s++) {
+            const int n = sizes[s];
+            axpyLaunch launch = selectAxpyLaunch<dataType>(info, n, 1, 1, 0);
+            const size_t globalWorkSize = finishAxpyLaunch(generic, device, launch);
+            specializationDefines defines{ { "SPEC_N", n }, { "SPEC_INCX", 1 }, { "SPEC_INCY", 1 } };
+            if (globalWorkSize * launch.width == static_cast<size_t>(n))
+                defines.push_back({ "SPEC_EXACT", 1 });
+            cl_kernel kernel = getSpecializedKernel(cache, context, device, kernelText, launch.kernelName, launch.options, defines, generic);
+            setArguments<dataType>(kernel, n, a, x, 1, y, 1);
+            execute(queue, kernel, globalWorkSize, launch.localWorkSize);
+        }
+        clFinish(queue);
+        double end = omp_get_wtime();
+        if (r == 0 || r + 1 >= repeats)
+            std::cout << "Pass " << r << " of " << sizes.size() << " sizes has time: " << end - start << " sec" << std::endl;
+    }
+    std::cout << "Specialized builds: " << cache.builds << ", hits: " << cache.hits << std::endl;
+
+    std::vector<dataType> result(maxSize);
+    if (clEnqueueReadBuffer(queue, y, CL_TRUE, 0, sizeof(dataType) * maxSize, result.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+    std::vector<dataType> xRef = getVector<dataType>(maxSize, seedX);
+    std::vector<dataType> yRef = getVector<dataType>(maxSize, seedY);
+    for (size_t s = 0; s < sizes.size(); s++)
+        host::axpy<dataType>(sizes[s], a, xRef.data(), 1, yRef.data(), 1);
+    compare<dataType>(yRef, result);
+
+    releaseSpecializationCache(cache);
+    clReleaseMemObject(x);
+    clReleaseMemObject(y);
+    clReleaseKernel(generic);
+    clReleaseKernel(generator);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+// AXPY moves 3 elements for 2 FLOP, far left of every ridge point, so it is judged against bandwidth
+void computeRoofline(const int& n, const uint64_t& seedX, const uint64_t& seedY) {
+    const double elements = static_cast<double>(n);
+    {
+        rooflinePeak host;
+        measureHostPeak(8, 1 << 25, host);
+        printPeak(host);
+        std::vector<float> xf = getVector<float>(n, seedX), yf = getVector<float>(n, seedY);
+        std::vector<double> xd = getVector<double>(n, seedX), yd = getVector<double>(n, seedY);
+        double start = omp_get_wtime();
+        host::saxpy(n, 0.2f, xf.data(), 1, yf.data(), 1);
+        double middle = omp_get_wtime();
+        host::daxpy(n, 0.2, xd.data(), 1, yd.data(), 1);
+        double end = omp_get_wtime();
+        printRoofline(host, { { "saxpy", 2 * elements, 3 * sizeof(float) * elements, middle - start },
+                              { "daxpy", 2 * elements, 3 * sizeof(double) * elements, end - middle } });
+    }
+
+    const cl_device_type deviceTypes[2]{ CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
+    for (size_t i = 0; i < 2; i++) {
+        try {
+            deviceInfo info;
+            selectDevice(deviceTypes[i], info);
+            rooflinePeak peak;
+            measureDevicePeak(info, 1 << 25, peak);
+            printPeak(peak);
+            std::vector<rooflinePoint> points;
+            std::vector<float> yf;
+            const double sTime = computeOnDevice<float>(n, 1, 1, seedX, seedY, 0.2f, deviceTypes[i], std::vector<char>(), 0, yf);
+            points.push_back({ "saxpy", 2 * elements, 3 * sizeof(float) * elements, sTime });
+            if (info.fp64) {
+                std::vector<double> yd;
+                const double dTime = computeOnDevice<double>(n, 1, 1, seedX, seedY, 0.2, deviceTypes[i], std::vector<char>(), 0, yd);
+                points.push_back({ "daxpy", 2 * elements, 3 * sizeof(double) * elements, dTime });
+            }
+            printRoofline(peak, points);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+}
+
+void hostAxpy(const int& n, const float& a, const float* x, const int& incx, float* y, const int& incy) {
+    host::saxpy(n, a, x, incx, y, incy);
+}
+
+void hostAxpy(const int& n, const double& a, const double* x, const int& incx, double* y, const int& incy) {
+    host::daxpy(n, a, x, incx, y, incy);
+}
+
+// Low footprint benchmark: x and y are the only full length host arrays, every backend updates y in place
+// (or on the device) and is verified chunk by chunk against a reference rebuilt from the seeds
+template <typename dataType>
+void computeLowMemory(const int& n, const dataType& a, const uint64_t& seedX, const uint64_t& seedY, const size_t chunk,
+                      const std::vector<char>& kernelText) {
+    {
+        std::vector<dataType> x(n), y(n);
+        rng::fillUniform(x.data(), 0, x.size(), seedX, dataType(-100), dataType(100));
+        rng::fillUniform(y.data(), 0, y.size(), seedY, dataType(-100), dataType(100));
+        const std::function<void(size_t, size_t, dataType*)> readY = [&y](size_t offset, size_t count, dataType* dst) {
+            std::copy(y.begin() + offset, y.begin() + offset + count, dst);
+        };
+
+        std::cout << "OpenMP start" << std::endl;
+        double start = omp_get_wtime();
+        hostAxpy(n, a, x.data(), 1, y.data(), 1);
+        double end = omp_get_wtime();
+        std::cout << "OpenMP time: " << end - start << " sec" << std::endl;
+        verifyChunked<dataType>(n, 1, 1, a, seedX, seedY, chunk, readY);
+        std::cout << std::endl;
+
+        rng::fillUniform(y.data(), 0, y.size(), seedY, dataType(-100), dataType(100));
+        std::cout << "Work stealing start" << std::endl;
+        start = omp_get_wtime();
+        host::axpyTasks<dataType>(n, a, x.data(), 1, y.data(), 1);
+        end = omp_get_wtime();
+        std::cout << "Work stealing time: " << end - start << " sec" << std::endl;
+        verifyChunked<dataType>(n, 1, 1, a, seedX, seedY, chunk, readY);
+        std::cout << std::endl;
+    }
+
+    const cl_device_type deviceTypes[2]{ CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
+    for (size_t i = 0; i < 2; i++) {
+        std::cout << "OpenCL " << (deviceTypes[i] == CL_DEVICE_TYPE_GPU ? "GPU" : "CPU") << " start" << std::endl;
+        try {
+            std::vector<dataType> unused;
+            computeOnDevice<dataType>(n, 1, 1, seedX, seedY, a, deviceTypes[i], kernelText, 0, unused, chunk);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Samples every AXPY variant repeats times and appends the results to the store at path
+void recordBenchmarks(const int& n, const size_t repeats, const uint64_t& seedX, const uint64_t& seedY, const std::string& path) {
+    const std::string revision = currentRevision();
+    const std::string timestamp = currentTimestamp();
+    const std::string shape = "n=" + std::to_string(n);
+    std::vector<benchmarkResult> results;
+    {
+        const std::string driver = "OpenMP " + std::to_string(_OPENMP);
+        benchmarkResult saxpy{ revision, timestamp, "host", driver, "host::saxpy", shape, {} };
+        benchmarkResult daxpy{ revision, timestamp, "host", driver, "host::daxpy", shape, {} };
+        std::vector<float> xf = getVector<float>(n, seedX), yf = getVector<float>(n, seedY);
+        std::vector<double> xd = getVector<double>(n, seedX), yd = getVector<double>(n, seedY);
+        for (size_t r = 0; r < repeats; r++) {
+            double start = omp_get_wtime();
+            host::saxpy(n, 0.2f, xf.data(), 1, yf.data(), 1);
+            double middle = omp_get_wtime();
+            host::daxpy(n, 0.2, xd.data(), 1, yd.data(), 1);
+            double end = omp_get_wtime();
+            saxpy.samples.push_back(middle - start);
+            daxpy.samples.push_back(end - middle);
+        }
+        results.push_back(saxpy);
+        results.push_back(daxpy);
+        benchmarkResult tasks{ revision, timestamp, "host", "work stealing pool", "host::axpyTasks<float>", shape, {} };
+        for (size_t r = 0; r < repeats; r++) {
+            double start = omp_get_wtime();
+            host::axpyTasks<float>(n, 0.2f, xf.data(), 1, yf.data(), 1);
+            double end = omp_get_wtime();
+            tasks.samples.push_back(end - start);
+        }
+        results.push_back(tasks);
+    }
+
+    const cl_device_type deviceTypes[2]{ CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
+    for (size_t i = 0; i < 2; i++) {
+        try {
+            deviceInfo info;
+            selectDevice(deviceTypes[i], info);
+            // variants are recorded under the kernel the launch selection picks for this device
+            benchmarkResult saxpy{ revision, timestamp, info.name, info.driverVersion, selectAxpyLaunch<float>(info, n, 1, 1, 0).kernelName, shape, {} };
+            for (size_t r = 0; r < repeats; r++) {
+                std::vector<float> y;
+                saxpy.samples.push_back(computeOnDevice<float>(n, 1, 1, seedX, seedY, 0.2f, deviceTypes[i], std::vector<char>(), 0, y));
+            }
+            results.push_back(saxpy);
+            if (info.fp64) {
+                benchmarkResult daxpy{ revision, timestamp, info.name, info.driverVersion, selectAxpyLaunch<double>(info, n, 1, 1, 0).kernelName, shape, {} };
+                for (size_t r = 0; r < repeats; r++) {
+                    std::vector<double> y;
+                    daxpy.samples.push_back(computeOnDevice<double>(n, 1, 1, seedX, seedY, 0.2, deviceTypes[i], std::vector<char>(), 0, y));
+                }
+                results.push_back(daxpy);
+            }
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+    appendResults(path, results);
+    std::cout << results.size() << " results of " << revision << " appended to " << path << std::endl;
+}
+
+void printPrimitive(const std::string& name, const size_t n, const double seconds, const bool matches) {
+    std::cout << name << " time: " << seconds << " sec, " << n / seconds * 1e-6 << " Mkeys/s, "
+        << (matches ? "matches the reference" : "DIFFERS from the reference") << std::endl;
+}
+
+cl_mem createPrimitiveInput(const primitives& p, const void* data, const size_t bytes) {
+    cl_int retCode;
+    cl_mem buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, const_cast<void*>(data), &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create primitives buffer");
+    return buffer;
+}
+
+template <typename T>
+void readPrimitiveOutput(const primitives& p, const cl_mem& buffer, std::vector<T>& out) {
+    if (!out.empty() && clEnqueueReadBuffer(p.queue, buffer, CL_TRUE, 0, sizeof(T) * out.size(), out.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+}
+
+// Scan, compaction and radix sort of n keys on the host and on the device. The Open MP results are checked
+// against sequential loops (std::sort for the sort) and then serve as the device reference. Scan inputs
+// are small so that 32-bit sums don't wrap, about 10% of the compacted floats are non-zero.
+void computePrimitives(const cl_device_type deviceType, const size_t n, const uint64_t& seed) {
+    std::vector<uint32_t> keys(n), digits(n), sortedValues(n);
+    std::vector<float> sparse(n);
+#pragma omp parallel for num_threads(8)
+    for (long long b = 0; b < static_cast<long long>((n + 3) / 4); b++) {
+        uint32_t r[4];
+        rng::philox4x32(static_cast<uint64_t>(b), seed, r);
+        for (size_t lane = 0; lane < 4 && 4 * b + lane < n; lane++) {
+            const size_t i = 4 * b + lane;
+            keys[i] = r[lane];
+            digits[i] = r[lane] & 0xF;
+            sparse[i] = r[lane] % 10 == 0 ? rng::toUniform(r[lane], 1.0f, 2.0f) : 0.0f;
+            sortedValues[i] = static_cast<uint32_t>(i);
+        }
+    }
+
+    std::vector<uint32_t> refScan(n), refInclusive(n), refKeys(keys), refPairKeys(keys), refPairValues(sortedValues);
+    std::vector<float> refValues;
+    std::vector<uint32_t> refIndices;
+    double times[5]{};
+    times[0] = omp_get_wtime();
+    host::scan(digits.data(), refScan.data(), n, false);
+    times[1] = omp_get_wtime();
+    host::scan(digits.data(), refInclusive.data(), n, true);
+    times[2] = omp_get_wtime();
+    host::compact(sparse.data(), n, refValues, refIndices);
+    times[3] = omp_get_wtime();
+    host::radixSort(refKeys.data(), nullptr, n);
+    times[4] = omp_get_wtime();
+    host::radixSort(refPairKeys.data(), refPairValues.data(), n);
+    double end = omp_get_wtime();
+
+    // sequential references for the scans and the compaction
+    bool scansMatch[2]{ true, true };
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        scansMatch[0] = scansMatch[0] && refScan[i] == sum;
+        sum += digits[i];
+        scansMatch[1] = scansMatch[1] && refInclusive[i] == sum;
+    }
+    bool compactMatches = true;
+    size_t kept = 0;
+    for (size_t i = 0; i < n && compactMatches; i++) {
+        if (sparse[i] != 0.0f) {
+            compactMatches = kept < refValues.size() && refValues[kept] == sparse[i] && refIndices[kept] == i;
+            kept++;
+        }
+    }
+    compactMatches = compactMatches && kept == refValues.size() && kept == refIndices.size();
+
+    std::vector<uint32_t> sortedKeys(keys);
+    double sortStart = omp_get_wtime();
+    std::sort(sortedKeys.begin(), sortedKeys.end());
+    double sortEnd = omp_get_wtime();
+    bool pairsMatch = refPairKeys == sortedKeys;
+    for (size_t i = 0; i < n && pairsMatch; i++)
+        pairsMatch = keys[refPairValues[i]] == refPairKeys[i] && (i == 0 || refPairKeys[i - 1] != refPairKeys[i] || refPairValues[i - 1] < refPairValues[i]);
+    std::cout << "Open MP host" << std::endl;
+    printPrimitive("\texclusive scan", n, times[1] - times[0], scansMatch[0]);
+    printPrimitive("\tinclusive scan", n, times[2] - times[1], scansMatch[1]);
+    printPrimitive("\tcompaction", n, times[3] - times[2], compactMatches);
+    printPrimitive("\tradix sort", n, times[4] - times[3], refKeys == sortedKeys);
+    printPrimitive("\tradix sort by key", n, end - times[4], pairsMatch);
+    printPrimitive("\tstd::sort", n, sortEnd - sortStart, std::is_sorted(sortedKeys.begin(), sortedKeys.end()));
+
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    primitives p;
+    createPrimitives(info, p);
+    const cl_uint count = static_cast<cl_uint>(n);
+    cl_mem digitsBuffer = createPrimitiveInput(p, digits.data(), sizeof(uint32_t) * n);
+    cl_mem scanBuffer = createUintBuffer(p, n);
+    cl_mem sparseBuffer = createPrimitiveInput(p, sparse.data(), sizeof(float) * n);
+    cl_mem valuesBuffer = createUintBuffer(p, n);
+    cl_mem indicesBuffer = createUintBuffer(p, n);
+    cl_mem keysBuffer = createPrimitiveInput(p, keys.data(), sizeof(uint32_t) * n);
+    cl_mem pairKeysBuffer = createPrimitiveInput(p, keys.data(), sizeof(uint32_t) * n);
+    cl_mem pairValuesBuffer = createPrimitiveInput(p, sortedValues.data(), sizeof(uint32_t) * n);
+    clFinish(p.queue);
+
+    std::vector<uint32_t> result(n);
+    std::cout << info.name << std::endl;
+    double start = omp_get_wtime();
+    deviceScan(p, digitsBuffer, scanBuffer, count, false);
+    clFinish(p.queue);
+    end = omp_get_wtime();
+    readPrimitiveOutput(p, scanBuffer, result);
+    printPrimitive("\texclusive scan", n, end - start, result == refScan);
+
+    start = omp_get_wtime();
+    deviceScan(p, digitsBuffer, scanBuffer, count, true);
+    clFinish(p.queue);
+    end = omp_get_wtime();
+    readPrimitiveOutput(p, scanBuffer, result);
+    printPrimitive("\tinclusive scan", n, end - start, result == refInclusive);
+
+    start = omp_get_wtime();
+    const cl_uint deviceKept = deviceCompact(p, sparseBuffer, count, valuesBuffer, indicesBuffer);
+    end = omp_get_wtime();
+    std::vector<float> values(deviceKept);
+    std::vector<uint32_t> indices(deviceKept);
+    readPrimitiveOutput(p, valuesBuffer, values);
+    readPrimitiveOutput(p, indicesBuffer, indices);
+    printPrimitive("\tcompaction", n, end - start, values == refValues && indices == refIndices);
+
+    start = omp_get_wtime();
+    deviceRadixSort(p, keysBuffer, nullptr, count);
+    end = omp_get_wtime();
+    readPrimitiveOutput(p, keysBuffer, result);
+    printPrimitive("\tradix sort", n, end - start, result == sortedKeys);
+
+    start = omp_get_wtime();
+    deviceRadixSort(p, pairKeysBuffer, pairValuesBuffer, count);
+    end = omp_get_wtime();
+    readPrimitiveOutput(p, pairKeysBuffer, result);
+    readPrimitiveOutput(p, pairValuesBuffer, sortedValues);
+    // both radix sorts are stable, so the permutations must agree exactly
+    printPrimitive("\tradix sort by key", n, end - start, result == refPairKeys && sortedValues == refPairValues);
+
+    cl_mem buffers[8]{ digitsBuffer, scanBuffer, sparseBuffer, valuesBuffer, indicesBuffer, keysBuffer, pairKeysBuffer, pairValuesBuffer };
+    for (size_t i = 0; i < 8; i++)
+        clReleaseMemObject(buffers[i]);
+    releasePrimitives(p);
+}
+
+int main(int argc, char* argv[]) {
+    // lab2 --subdevices <numa|l3|equal:N|counts:N,M,...>: concurrent AXPY jobs on CPU sub-devices
+    if (argc > 2 && std::string(argv[1]) == "--subdevices") {
+        try {
+            computeOnSubDevices<float>(1 << 22, 0.2f, argv[2], 26);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab2 --roofline: STREAM bandwidth and peak FLOP/s per device, AXPY placed on each roofline
+    if (argc > 1 && std::string(argv[1]) == "--roofline") {
+        try {
+            computeRoofline(1 << 26, 26, 64);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab2 --record [repeats]: append timing samples of every variant to the results store ($LABS_RESULTS or lab2_results.csv)
+    if (argc > 1 && std::string(argv[1]) == "--record") {
+        try {
+            recordBenchmarks(1 << 26, argc > 2 ? std::stoul(argv[2]) : 10, 26, 64, resultsPath("lab2_results.csv"));
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab2 --lowmem [n] [chunk]: AXPY benchmark without full length reference or result copies
+    if (argc > 1 && std::string(argv[1]) == "--lowmem") {
+        try {
+            const int n = argc > 2 ? std::stoi(argv[2]) : 67108864;
+            const size_t chunk = argc > 3 ? std::stoul(argv[3]) : 1 << 20;
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            std::cout.setf(std::ios_base::fixed);
+            std::cout << "******************** FLOAT ********************" << std::endl;
+            computeLowMemory<float>(n, 0.2f, 26, 64, chunk, kernelText);
+            std::cout << "******************** DOUBLE ********************" << std::endl;
+            computeLowMemory<double>(n, 0.2, 26, 64, chunk, kernelText);
+            printPeakRss();
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab2 --compare <baseline> [candidate]: flag variants whose median time regressed against the baseline revision
+    if (argc > 2 && std::string(argv[1]) == "--compare")
+        return runCompare(argc, argv, resultsPath("lab2_results.csv"));
+    // lab2 --jit [gpu|cpu]: recurring sizes switch to shape specialized kernels
+    if (argc > 1 && std::string(argv[1]) == "--jit") {
+        try {
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeRepeated<float>(deviceType, { 1 << 12, 1 << 16, 1000000 }, 1000, 0.2f, 26, 64);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab2 --primitives [gpu|cpu]: scan, stream compaction and radix sort against their Open MP counterparts
+    if (argc > 1 && std::string(argv[1]) == "--primitives") {
+        try {
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computePrimitives(deviceType, 1 << 24, 26);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 3)
+        return runNpy(argc, argv);
+
     const int n = 67108864; // 2^26
     const int incx = 1;
     const int incy = 1;
+    const uint64_t seedX = 26;
+    const uint64_t seedY = 64;
     cl_device_type deviceTypeGPU = CL_DEVICE_TYPE_GPU;
     cl_device_type deviceTypeCPU = CL_DEVICE_TYPE_CPU;
 
-    cl_platform_id platform{};
-    getPlatform(platform);
     std::vector<char> kernelText;
-    readKernelFile(kernelText);
+    getKernelText(kernelText);
 
     std::cout.setf(std::ios_base::fixed);
     std::cout << "******************** FLOAT ********************" << std::endl;
     {
         const float a = 0.2f;
-        const std::vector<float> x = getVector<float>(n);
-        const std::vector<float> y = getVector<float>(n);
+        const std::vector<float> x = getVector<float>(n, seedX);
+        const std::vector<float> y = getVector<float>(n, seedY);
         
         // reference
         std::vector<float> yRef(y.begin(), y.end());
+        // read x, read and write y, one multiply and one add per element
+        const double elements = static_cast<double>(n / std::max(incx, incy));
+        const double bytes = 3.0 * sizeof(float) * elements;
         std::cout << "Reference start" << std::endl;
-        double start = omp_get_wtime();
-        host::axpy<float>(n, a, x.data(), incx, yRef.data(), incy);
-        double end = omp_get_wtime();
-        std::cout << "Reference time: " << end - start << " sec" << std::endl;
+        perfRegion("Reference", 1, bytes, 2.0 * elements, [&]() { host::axpy<float>(n, a, x.data(), incx, yRef.data(), incy); });
         std::cout << std::endl;
 
         // OpenMP
         std::vector<float> yOmp(y.begin(), y.end());
         std::cout << "OpenMP start" << std::endl;
-        start = omp_get_wtime();
-        host::saxpy(n, a, x.data(), incx, yOmp.data(), incy);
-        end = omp_get_wtime();
-        std::cout << "OpenMP time: " << end - start << " sec" << std::endl;
+        perfRegion("OpenMP", 8, bytes, 2.0 * elements, [&]() { host::saxpy(n, a, x.data(), incx, yOmp.data(), incy); });
         compare<float>(yRef, yOmp);
         yOmp.clear();
         std::cout << std::endl;
 
+        // work stealing
+        std::vector<float> yTasks(y.begin(), y.end());
+        std::cout << "Work stealing start" << std::endl;
+        double tasksStart = omp_get_wtime();
+        host::axpyTasks<float>(n, a, x.data(), incx, yTasks.data(), incy);
+        double tasksEnd = omp_get_wtime();
+        std::cout << "Work stealing time: " << (tasksEnd - tasksStart) << " sec" << std::endl;
+        compare<float>(yRef, yTasks);
+        yTasks.clear();
+        std::cout << std::endl;
+
         // GPU OpenCL
         std::cout << "OpenCL GPU start" << std::endl;
         // for (size_t localWorkSize = 8; localWorkSize <= 256; localWorkSize *= 2) {
             try {
-                size_t localWorkSize = 256;
-                std::vector<float> yGpu(y.begin(), y.end());
-                computeOnDevice<float>(n, incx, incy, x, a, deviceTypeGPU, platform, kernelText, localWorkSize, yGpu);
+                size_t localWorkSize = 0; // from device
+                std::vector<float> yGpu;
+                computeOnDevice<float>(n, incx, incy, seedX, seedY, a, deviceTypeGPU, kernelText, localWorkSize, yGpu);
                 compare<float>(yRef, yGpu);
                 std::cout << std::endl;
             }
@@ -148,9 +879,9 @@ int main() {
         std::cout << "OpenCL CPU start" << std::endl;
         // for (size_t localWorkSize = 8; localWorkSize <= 256; localWorkSize *= 2) {
             try {
-                size_t localWorkSize = 256;
-                std::vector<float> yCpu(y.begin(), y.end());
-                computeOnDevice<float>(n, incx, incy, x, a, deviceTypeCPU, platform, kernelText, localWorkSize, yCpu);
+                size_t localWorkSize = 0; // from device
+                std::vector<float> yCpu;
+                computeOnDevice<float>(n, incx, incy, seedX, seedY, a, deviceTypeCPU, kernelText, localWorkSize, yCpu);
                 compare<float>(yRef, yCpu);
                 std::cout << std::endl;
             }
@@ -163,36 +894,44 @@ int main() {
     std::cout << std::endl << "******************** DOUBLE ********************" << std::endl;
     {
         const double a = 0.2;
-        const std::vector<double> x = getVector<double>(n);
-        const std::vector<double> y = getVector<double>(n);
+        const std::vector<double> x = getVector<double>(n, seedX);
+        const std::vector<double> y = getVector<double>(n, seedY);
 
         // reference
         std::vector<double> yRef(y.begin(), y.end());
+        // read x, read and write y, one multiply and one add per element
+        const double elements = static_cast<double>(n / std::max(incx, incy));
+        const double bytes = 3.0 * sizeof(double) * elements;
         std::cout << "Reference start" << std::endl;
-        double start = omp_get_wtime();
-        host::axpy<double>(n, a, x.data(), incx, yRef.data(), incy);
-        double end = omp_get_wtime();
-        std::cout << "Reference time: " << end - start << " sec" << std::endl;
+        perfRegion("Reference", 1, bytes, 2.0 * elements, [&]() { host::axpy<double>(n, a, x.data(), incx, yRef.data(), incy); });
         std::cout << std::endl;
 
         // OpenMP
         std::vector<double> yOmp(y.begin(), y.end());
         std::cout << "OpenMP start" << std::endl;
-        start = omp_get_wtime();
-        host::daxpy(n, a, x.data(), incx, yOmp.data(), incy);
-        end = omp_get_wtime();
-        std::cout << "OpenMP time: " << end - start << " sec" << std::endl;
+        perfRegion("OpenMP", 8, bytes, 2.0 * elements, [&]() { host::daxpy(n, a, x.data(), incx, yOmp.data(), incy); });
         compare<double>(yRef, yOmp);
         yOmp.clear();
         std::cout << std::endl;
 
+        // work stealing
+        std::vector<double> yTasks(y.begin(), y.end());
+        std::cout << "Work stealing start" << std::endl;
+        double tasksStart = omp_get_wtime();
+        host::axpyTasks<double>(n, a, x.data(), incx, yTasks.data(), incy);
+        double tasksEnd = omp_get_wtime();
+        std::cout << "Work stealing time: " << (tasksEnd - tasksStart) << " sec" << std::endl;
+        compare<double>(yRef, yTasks);
+        yTasks.clear();
+        std::cout << std::endl;
+
         // GPU OpenCL
         std::cout << "OpenCL GPU start" << std::endl;
         //for (size_t localWorkSize = 8; localWorkSize <= 256; localWorkSize *= 2) {
             try {
-                size_t localWorkSize = 256;
-                std::vector<double> yGpu(y.begin(), y.end());
-                computeOnDevice<double>(n, incx, incy, x, a, deviceTypeGPU, platform, kernelText, localWorkSize, yGpu);
+                size_t localWorkSize = 0; // from device
+                std::vector<double> yGpu;
+                computeOnDevice<double>(n, incx, incy, seedX, seedY, a, deviceTypeGPU, kernelText, localWorkSize, yGpu);
                 compare<double>(yRef, yGpu);
                 std::cout << std::endl;
             }
@@ -205,9 +944,9 @@ int main() {
         std::cout << "OpenCL CPU start" << std::endl;
         //for (size_t localWorkSize = 8; localWorkSize <= 256; localWorkSize *= 2) {
             try {
-                size_t localWorkSize = 256;
-                std::vector<double> yCpu(y.begin(), y.end());
-                computeOnDevice<double>(n, incx, incy, x, a, deviceTypeCPU, platform, kernelText, localWorkSize, yCpu);
+                size_t localWorkSize = 0; // from device
+                std::vector<double> yCpu;
+                computeOnDevice<double>(n, incx, incy, seedX, seedY, a, deviceTypeCPU, kernelText, localWorkSize, yCpu);
                 compare<double>(yRef, yCpu);
                 std::cout << std::endl;
             }
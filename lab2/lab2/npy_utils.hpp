@@ -0,0 +1,204 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Memory-mapped NumPy .npy files (C order, little endian). The data pointer of an npyArray
+// points straight into the mapping, so it can be handed to host kernels or CL_MEM_USE_HOST_PTR buffers.
+
+struct npyArray {
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t dataOffset = 0;
+    std::string descr;
+    std::vector<size_t> shape;
+    bool writable = false;
+};
+
+// Written files put the data on a page boundary so drivers can use the mapping without a copy
+const size_t NPY_DATA_ALIGNMENT = 4096;
+
+template <typename dataType>
+std::string npyDescr();
+
+template <>
+std::string npyDescr<float>() {
+    return "<f4";
+}
+
+template <>
+std::string npyDescr<double>() {
+    return "<f8";
+}
+
+// Throws when the product of the shape overflows size_t, as a crafted header can declare
+size_t npyElements(const npyArray& array) {
+    size_t count = 1;
+    for (size_t i = 0; i < array.shape.size(); i++) {
+        if (array.shape[i] != 0 && count > SIZE_MAX / array.shape[i])
+            throw std::runtime_error("Too large npy shape");
+        count *= array.shape[i];
+    }
+    return count;
+}
+
+template <typename dataType>
+dataType* npyData(const npyArray& array) {
+    if (array.descr != npyDescr<dataType>())
+        throw std::runtime_error("Npy data type " + array.descr + " doesn't match " + npyDescr<dataType>());
+    return reinterpret_cast<dataType*>(static_cast<char*>(array.mapping) + array.dataOffset);
+}
+
+std::string npyHeaderValue(const std::string& header, const std::string& key) {
+    size_t pos = header.find("'" + key + "'");
+    if (pos == std::string::npos)
+        throw std::runtime_error("Npy header has no " + key);
+    pos = header.find(':', pos);
+    if (pos == std::string::npos)
+        throw std::runtime_error("Broken npy header");
+    pos = header.find_first_not_of(' ', pos + 1);
+    if (pos == std::string::npos)
+        throw std::runtime_error("Broken npy header");
+    size_t end = header[pos] == '(' ? header.find(')', pos) : header.find_first_of(",}", pos);
+    if (end == std::string::npos)
+        throw std::runtime_error("Broken npy header");
+    if (header[pos] == '(')
+        end++;
+    return header.substr(pos, end - pos);
+}
+
+void parseNpyHeader(const std::string& header, npyArray& array) {
+    std::string descr = npyHeaderValue(header, "descr");
+    if (descr.size() < 2 || (descr.front() != '\'' && descr.front() != '"'))
+        throw std::runtime_error("Broken npy descr");
+    array.descr = descr.substr(1, descr.size() - 2);
+    if (array.descr == "|f4" || array.descr == "=f4")
+        array.descr = "<f4";
+    if (array.descr == "|f8" || array.descr == "=f8")
+        array.descr = "<f8";
+
+    if (npyHeaderValue(header, "fortran_order") != "False")
+        throw std::runtime_error("Unsupported fortran order npy");
+
+    std::string shape = npyHeaderValue(header, "shape");
+    array.shape.clear();
+    for (size_t pos = 1; pos < shape.size();) {
+        size_t next = shape.find_first_of(",)", pos);
+        std::string dim = shape.substr(pos, next - pos);
+        if (dim.find_first_not_of(' ') != std::string::npos)
+            array.shape.push_back(std::stoull(dim));
+        pos = next + 1;
+    }
+}
+
+void closeNpy(npyArray& array) {
+    if (array.mapping != nullptr) {
+        if (array.writable)
+            msync(array.mapping, array.mappingSize, MS_SYNC);
+        munmap(array.mapping, array.mappingSize);
+        array.mapping = nullptr;
+    }
+    if (array.fd != -1) {
+        close(array.fd);
+        array.fd = -1;
+    }
+}
+
+void openNpy(const std::string& path, npyArray& array, const bool writable = false) {
+    array.fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (array.fd == -1)
+        throw std::runtime_error("Can't open npy file " + path);
+    // the header checks below throw with the file mapped, don't leave the mapping and fd behind
+    try {
+        struct stat st {};
+        if (fstat(array.fd, &st) != 0)
+            throw std::runtime_error("Can't stat npy file " + path);
+        array.mappingSize = static_cast<size_t>(st.st_size);
+        array.writable = writable;
+        array.mapping = mmap(NULL, array.mappingSize, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, array.fd, 0);
+        if (array.mapping == MAP_FAILED) {
+            array.mapping = nullptr;
+            throw std::runtime_error("Can't map npy file " + path);
+        }
+
+        const unsigned char* raw = static_cast<const unsigned char*>(array.mapping);
+        if (array.mappingSize < 10 || memcmp(raw, "\x93NUMPY", 6) != 0)
+            throw std::runtime_error("Not a npy file " + path);
+        size_t headerLen = 0;
+        size_t headerStart = 0;
+        if (raw[6] == 1) {
+            headerLen = raw[8] | (raw[9] << 8);
+            headerStart = 10;
+        } else {
+            if (array.mappingSize < 12)
+                throw std::runtime_error("Broken npy file " + path);
+            headerLen = raw[8] | (raw[9] << 8) | (raw[10] << 16) | (static_cast<size_t>(raw[11]) << 24);
+            headerStart = 12;
+        }
+        array.dataOffset = headerStart + headerLen;
+        if (array.dataOffset > array.mappingSize)
+            throw std::runtime_error("Broken npy file " + path);
+        parseNpyHeader(std::string(reinterpret_cast<const char*>(raw) + headerStart, headerLen), array);
+
+        const size_t elementSize = array.descr == "<f8" ? 8 : 4;
+        if (npyElements(array) > (array.mappingSize - array.dataOffset) / elementSize)
+            throw std::runtime_error("Truncated npy file " + path);
+        madvise(array.mapping, array.mappingSize, MADV_SEQUENTIAL);
+    } catch (...) {
+        closeNpy(array);
+        throw;
+    }
+}
+
+template <typename dataType>
+void createNpy(const std::string& path, const std::vector<size_t>& shape, npyArray& array) {
+    std::string header = "{'descr': '" + npyDescr<dataType>() + "', 'fortran_order': False, 'shape': (";
+    for (size_t i = 0; i < shape.size(); i++)
+        header += std::to_string(shape[i]) + (shape.size() == 1 || i + 1 < shape.size() ? ", " : "");
+    header += "), }";
+    const size_t headerStart = 10;
+    if (header.size() + 1 + headerStart > NPY_DATA_ALIGNMENT)
+        throw std::runtime_error("Too long npy header");
+    header.append(NPY_DATA_ALIGNMENT - headerStart - header.size() - 1, ' ');
+    header += '\n';
+
+    array.shape = shape;
+    array.descr = npyDescr<dataType>();
+    array.dataOffset = NPY_DATA_ALIGNMENT;
+    const size_t elements = npyElements(array);
+    if (elements > (SIZE_MAX - array.dataOffset) / sizeof(dataType))
+        throw std::runtime_error("Too large npy shape");
+    array.mappingSize = array.dataOffset + elements * sizeof(dataType);
+    array.writable = true;
+    array.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (array.fd == -1)
+        throw std::runtime_error("Can't create npy file " + path);
+    try {
+        if (ftruncate(array.fd, static_cast<off_t>(array.mappingSize)) != 0)
+            throw std::runtime_error("Can't resize npy file " + path);
+        array.mapping = mmap(NULL, array.mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, array.fd, 0);
+        if (array.mapping == MAP_FAILED) {
+            array.mapping = nullptr;
+            throw std::runtime_error("Can't map npy file " + path);
+        }
+
+        unsigned char* raw = static_cast<unsigned char*>(array.mapping);
+        memcpy(raw, "\x93NUMPY", 6);
+        raw[6] = 1;
+        raw[7] = 0;
+        raw[8] = static_cast<unsigned char>(header.size() & 0xFF);
+        raw[9] = static_cast<unsigned char>(header.size() >> 8);
+        memcpy(raw + headerStart, header.data(), header.size());
+    } catch (...) {
+        closeNpy(array);
+        throw;
+    }
+}
@@ -4,44 +4,14 @@
 #include <stdexcept>
 #include <vector>
 #include <cstring>
-#include <fstream>
 #include <string>
+#include <algorithm>
+#include <type_traits>
 
-void getPlatform(cl_platform_id& platform) {
-    cl_uint numPlatforms = 0;
-    if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number platforms");
-
-    std::vector<cl_platform_id> platforms(numPlatforms);
-    if (clGetPlatformIDs(numPlatforms, platforms.data(), NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get platforms");
-
-    for (cl_uint i = 0; i < numPlatforms; i++) {
-        const size_t paramValueSize = 100;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetPlatformInfo(platforms[i], CL_PLATFORM_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get platforms info");
-        name[parValRetSize] = '\0';
-        if (strstr(name, "Intel") != nullptr) {
-            platform = platforms[i];
-            return;
-        }
-    }
-
-    throw std::runtime_error("Can't find Intel platform");
-}
-
-void getDevice(const cl_platform_id& platform, const cl_device_type& dt, cl_device_id& device) {
-    cl_uint numDevices = 0;
-    if (clGetDeviceIDs(platform, dt, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices > 1)
-        throw std::runtime_error("Unsupport more than one device");
-
-    if (clGetDeviceIDs(platform, dt, numDevices, &device, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get devices");
-}
+#include "random_utils.hpp"
+#include "device_info.hpp"
+#include "program_cache.hpp"
+#include "axpy_cl.hpp"
 
 void createContext(const cl_platform_id& platform, const cl_device_id& device, cl_context& context) {
     cl_context_properties contextProp[3]{ CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
@@ -51,6 +21,70 @@ void createContext(const cl_platform_id& platform, const cl_device_id& device, c
         throw std::runtime_error("Can't create context");
 }
 
+enum partitionType {
+    EQUALLY,
+    BY_COUNTS,
+    BY_AFFINITY_NUMA,
+    BY_AFFINITY_L3
+};
+
+// "numa", "l3", "equal:<units>" or "counts:<units>,<units>,..."
+void parsePartition(const std::string& spec, partitionType& pt, std::vector<cl_uint>& counts) {
+    counts.clear();
+    if (spec == "numa") {
+        pt = partitionType::BY_AFFINITY_NUMA;
+    } else if (spec == "l3") {
+        pt = partitionType::BY_AFFINITY_L3;
+    } else if (spec.compare(0, 6, "equal:") == 0) {
+        pt = partitionType::EQUALLY;
+        counts.push_back(static_cast<cl_uint>(std::stoul(spec.substr(6))));
+    } else if (spec.compare(0, 7, "counts:") == 0) {
+        pt = partitionType::BY_COUNTS;
+        for (size_t pos = 7; pos < spec.size();) {
+            size_t next = spec.find(',', pos);
+            if (next == std::string::npos)
+                next = spec.size();
+            counts.push_back(static_cast<cl_uint>(std::stoul(spec.substr(pos, next - pos))));
+            pos = next + 1;
+        }
+    } else {
+        throw std::runtime_error("Unknown partition " + spec);
+    }
+}
+
+// counts holds compute units per sub-device (one value for EQUALLY)
+void createSubDevices(const cl_device_id& device, const partitionType pt, const std::vector<cl_uint>& counts, std::vector<cl_device_id>& subDevices) {
+    std::vector<cl_device_partition_property> props;
+    if (pt == partitionType::EQUALLY) {
+        if (counts.size() != 1)
+            throw std::runtime_error("Equally partition needs one count");
+        props = { CL_DEVICE_PARTITION_EQUALLY, static_cast<cl_device_partition_property>(counts[0]), 0 };
+    } else if (pt == partitionType::BY_COUNTS) {
+        props.push_back(CL_DEVICE_PARTITION_BY_COUNTS);
+        for (size_t i = 0; i < counts.size(); i++)
+            props.push_back(static_cast<cl_device_partition_property>(counts[i]));
+        props.push_back(CL_DEVICE_PARTITION_BY_COUNTS_LIST_END);
+        props.push_back(0);
+    } else {
+        const cl_device_affinity_domain domain = pt == partitionType::BY_AFFINITY_NUMA ? CL_DEVICE_AFFINITY_DOMAIN_NUMA : CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE;
+        props = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, static_cast<cl_device_partition_property>(domain), 0 };
+    }
+
+    cl_uint numSubDevices = 0;
+    cl_int retCode = clCreateSubDevices(device, props.data(), 0, NULL, &numSubDevices);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't partition device: " + std::to_string(retCode));
+    subDevices.resize(numSubDevices);
+    if (clCreateSubDevices(device, props.data(), numSubDevices, subDevices.data(), NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't create sub devices");
+}
+
+void releaseSubDevices(std::vector<cl_device_id>& subDevices) {
+    for (size_t i = 0; i < subDevices.size(); i++)
+        clReleaseDevice(subDevices[i]);
+    subDevices.clear();
+}
+
 void createQueue(const cl_context& context, const cl_device_id& device, cl_command_queue& queue) {
     cl_int retCode = 0;
     queue = clCreateCommandQueueWithProperties(context, device, NULL, &retCode);
@@ -58,39 +92,33 @@ void createQueue(const cl_context& context, const cl_device_id& device, cl_comma
         throw std::runtime_error("Can't create queue");
 }
 
-void readKernelFile(std::vector<char>& kernelText) {
-    std::ifstream desc("axpy.cl", std::ios_base::ate | std::ios_base::binary);
-    std::streamoff fileSize = desc.tellg();
-    if (fileSize == -1)
-        throw std::runtime_error("Can't read kernel file");
-
-    desc.seekg(0, std::ios_base::beg);
-    kernelText.resize(fileSize);
-    desc.read(&kernelText[0], fileSize);
+// axpy.cl is compiled into the binary (axpy_cl.hpp, regenerate with tools/embed_cl.py), the text keeps its terminating null
+void getKernelText(std::vector<char>& kernelText) {
+    kernelText.assign(axpySource, axpySource + sizeof(axpySource));
 }
 
 void createProgramAndKernel(const cl_context& context, const cl_device_id& device, cl_program& program, cl_kernel& kernel,
-                            const std::string kernelName) {
+                            const std::string kernelName, const std::string options = "") {
     std::vector<char> kernelText;
-    readKernelFile(kernelText);
-    kernelText.push_back(0);
-    const char* rawKernelText = &kernelText[0];
+    getKernelText(kernelText);
+    buildProgram(context, device, kernelText, options, program);
 
     cl_int retCode;
-    program = clCreateProgramWithSource(context, 1, &rawKernelText, 0, &retCode);
+    kernel = clCreateKernel(program, kernelName.c_str(), &retCode);
     if (retCode != CL_SUCCESS)
-        throw std::runtime_error("Can't create program with source");
-    if (clBuildProgram(program, 1, &device, NULL, NULL, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't build program");
+        throw std::runtime_error("Can't create kernel");
+}
 
+void createKernel(const cl_program& program, cl_kernel& kernel, const std::string kernelName) {
+    cl_int retCode;
     kernel = clCreateKernel(program, kernelName.c_str(), &retCode);
     if (retCode != CL_SUCCESS)
-        throw std::runtime_error("Can't create kernel");
+        throw std::runtime_error("Can't create kernel " + kernelName);
 }
 
 void createMemoryObject(const cl_context& context, cl_mem& x, cl_mem& y, const size_t& size, const size_t dataSize) {
     cl_int retCode;
-    x = clCreateBuffer(context, CL_MEM_READ_ONLY, dataSize * size, NULL, &retCode);
+    x = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize * size, NULL, &retCode);
     if (retCode != CL_SUCCESS)
         throw std::runtime_error("Can't create input buffer");
     y = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize * size, NULL, &retCode);
@@ -119,8 +147,73 @@ void setArguments(const cl_kernel& kernel, const int& n, const dataType& a, cons
         throw std::runtime_error("Can't set 5 kernel arg");
 }
 
+struct axpyLaunch {
+    std::string kernelName;
+    std::string options;
+    size_t width{};
+    size_t items{};
+    size_t localWorkSize{};
+};
+
+// Unit strides use the vector kernel at the device preferred width; localWorkSize == 0 takes the group size from the device
+template <typename dataType>
+axpyLaunch selectAxpyLaunch(const deviceInfo& info, const int& n, const int& incx, const int& incy, const size_t& localWorkSize) {
+    const bool isFloat = std::is_same<dataType, float>::value;
+    if (!isFloat && !info.fp64)
+        throw std::runtime_error("Device doesn't support fp64");
+
+    axpyLaunch launch;
+    launch.options = deviceBuildOptions(info);
+    cl_uint width = isFloat ? info.vectorWidthFloat : info.vectorWidthDouble;
+    if (incx == 1 && incy == 1 && (width == 2 || width == 4 || width == 8 || width == 16)) {
+        launch.kernelName = isFloat ? "saxpyVec" : "daxpyVec";
+        launch.options += " -DVEC_WIDTH=" + std::to_string(width);
+    } else {
+        width = 1;
+        launch.kernelName = isFloat ? "saxpy" : "daxpy";
+    }
+    launch.width = width;
+    launch.items = (n + width - 1) / width;
+    launch.localWorkSize = localWorkSize != 0 ? localWorkSize : std::min<size_t>(info.maxWorkGroupSize, 256);
+    return launch;
+}
+
+// Clamps the group to what the built kernel allows and rounds the global size up to whole groups
+size_t finishAxpyLaunch(const cl_kernel& kernel, const cl_device_id& device, axpyLaunch& launch) {
+    size_t maxLocWorkGroup{};
+    if (clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxLocWorkGroup, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't get kernel work group info");
+    launch.localWorkSize = std::min(launch.localWorkSize, maxLocWorkGroup);
+    return (launch.items + launch.localWorkSize - 1) / launch.localWorkSize * launch.localWorkSize;
+}
+
 void execute(const cl_command_queue& queue, cl_kernel& kernel, const size_t& globalWorkSize, const size_t& localWorkSize) {
     if (clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL) != CL_SUCCESS)
         throw std::runtime_error("Can't run kernel execution");
 }
 
+
+// Fills the first n elements of buffer on the device with the rng stream of seed (same stream as rng::fillUniform, values equal up to rounding)
+template <typename dataType>
+void generateOnDevice(const cl_command_queue& queue, const cl_kernel& generator, const cl_mem& buffer, const int& n,
+                      const uint64_t& seed, const dataType& lo, const dataType& hi) {
+    const cl_uint seedLo = static_cast<cl_uint>(seed);
+    const cl_uint seedHi = static_cast<cl_uint>(seed >> 32);
+    if (clSetKernelArg(generator, 0, sizeof(cl_mem), &buffer) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 0 generator arg");
+    if (clSetKernelArg(generator, 1, sizeof(int), &n) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 1 generator arg");
+    if (clSetKernelArg(generator, 2, sizeof(cl_uint), &seedLo) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 2 generator arg");
+    if (clSetKernelArg(generator, 3, sizeof(cl_uint), &seedHi) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 3 generator arg");
+    if (clSetKernelArg(generator, 4, sizeof(dataType), &lo) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 4 generator arg");
+    if (clSetKernelArg(generator, 5, sizeof(dataType), &hi) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 5 generator arg");
+
+    const size_t elementsPerItem = 16 / sizeof(dataType);
+    const size_t globalWorkSize = (n + elementsPerItem - 1) / elementsPerItem;
+    if (clEnqueueNDRangeKernel(queue, generator, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't run generator execution");
+}
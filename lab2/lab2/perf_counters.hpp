@@ -0,0 +1,205 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <omp.h>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Hardware counters (perf_event_open) around host regions. Every OpenMP thread of a team of the given size
+// opens counters for itself, so regions must run their parallel loops with the same team size (the host
+// paths use num_threads(8)); the master thread is thread 0 and covers serial code. Events the kernel or
+// the PMU doesn't provide (VMs, perf_event_paranoid) are reported as unavailable instead of failing the run.
+
+enum perfEvent {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    L1D_MISSES,
+    DTLB_MISSES,
+    PERF_EVENT_COUNT
+};
+
+const char* const perfEventNames[PERF_EVENT_COUNT]{ "cycles", "instructions", "LLC misses", "L1D misses", "dTLB misses" };
+
+struct perfCounters {
+    std::vector<std::array<int, PERF_EVENT_COUNT>> fds;
+    std::vector<std::array<uint64_t, PERF_EVENT_COUNT>> values;
+    std::string error;
+};
+
+int openPerfEvent(const perfEvent event) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    const uint64_t readMiss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    switch (event) {
+    case perfEvent::CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case perfEvent::INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case perfEvent::LLC_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | readMiss;
+        break;
+    case perfEvent::L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | readMiss;
+        break;
+    default:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | readMiss;
+        break;
+    }
+    // pid 0 and cpu -1: the calling thread on whichever cpu it runs
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+void openPerfCounters(perfCounters& pc, const int threads) {
+    pc.fds.assign(threads, std::array<int, PERF_EVENT_COUNT>());
+    pc.values.assign(threads, std::array<uint64_t, PERF_EVENT_COUNT>());
+    pc.error.clear();
+    int lastErrno = 0;
+#pragma omp parallel num_threads(threads)
+    {
+        const int tid = omp_get_thread_num();
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            pc.fds[tid][e] = openPerfEvent(static_cast<perfEvent>(e));
+            if (pc.fds[tid][e] < 0) {
+#pragma omp critical
+                lastErrno = errno;
+            }
+        }
+    }
+    if (lastErrno != 0)
+        pc.error = strerror(lastErrno);
+}
+
+void startPerfCounters(perfCounters& pc) {
+    for (size_t t = 0; t < pc.fds.size(); t++) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (pc.fds[t][e] >= 0) {
+                ioctl(pc.fds[t][e], PERF_EVENT_IOC_RESET, 0);
+                ioctl(pc.fds[t][e], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+}
+
+// Counts are scaled by enabled/running time when the PMU had to multiplex the events
+void stopPerfCounters(perfCounters& pc) {
+    for (size_t t = 0; t < pc.fds.size(); t++) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            pc.values[t][e] = 0;
+            if (pc.fds[t][e] < 0)
+                continue;
+            ioctl(pc.fds[t][e], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3]{};
+            if (read(pc.fds[t][e], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0)
+                continue;
+            pc.values[t][e] = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+        }
+    }
+}
+
+void closePerfCounters(perfCounters& pc) {
+    for (size_t t = 0; t < pc.fds.size(); t++) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (pc.fds[t][e] >= 0)
+                close(pc.fds[t][e]);
+        }
+    }
+    pc.fds.clear();
+}
+
+void printPerfRow(const std::string& label, const std::array<int, PERF_EVENT_COUNT>& available, const std::array<uint64_t, PERF_EVENT_COUNT>& values,
+                  const double flops) {
+    std::cout << "\t" << std::setw(6) << label;
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        std::cout << "  " << perfEventNames[e] << ": ";
+        if (available[e] > 0)
+            std::cout << values[e];
+        else
+            std::cout << "n/a";
+    }
+    if (available[perfEvent::CYCLES] > 0 && available[perfEvent::INSTRUCTIONS] > 0 && values[perfEvent::CYCLES] != 0)
+        std::cout << "  IPC: " << std::setprecision(2) << static_cast<double>(values[perfEvent::INSTRUCTIONS]) / values[perfEvent::CYCLES];
+    if (available[perfEvent::LLC_MISSES] > 0 && flops > 0)
+        std::cout << "  LLC bytes/FLOP: " << std::setprecision(3) << 64.0 * values[perfEvent::LLC_MISSES] / flops;
+    std::cout << std::endl;
+}
+
+// bytes and flops are the nominal traffic and work of the region, used for the derived ratios
+void printPerfCounters(const perfCounters& pc, const double seconds, const double bytes, const double flops) {
+    const std::ios_base::fmtflags flags = std::cout.flags();
+    const std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(3) << "\tperf: " << bytes / flops << " bytes/FLOP, "
+        << flops / seconds * 1e-9 << " GFLOP/s, " << bytes / seconds * 1e-9 << " GB/s" << std::endl;
+
+    // total holds the number of threads that opened each event
+    std::array<int, PERF_EVENT_COUNT> total{};
+    std::array<uint64_t, PERF_EVENT_COUNT> sum{};
+    int opened = 0;
+    for (size_t t = 0; t < pc.values.size(); t++) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            total[e] += pc.fds[t][e] >= 0 ? 1 : 0;
+            sum[e] += pc.values[t][e];
+            opened += pc.fds[t][e] >= 0 ? 1 : 0;
+        }
+    }
+    if (opened == 0) {
+        std::cout << "\tperf counters are unavailable: " << pc.error << std::endl;
+    } else {
+        if (!pc.error.empty())
+            std::cout << "\tsome perf counters are unavailable: " << pc.error << std::endl;
+        for (size_t t = 0; pc.values.size() > 1 && t < pc.values.size(); t++) {
+            std::array<int, PERF_EVENT_COUNT> available{};
+            for (int e = 0; e < PERF_EVENT_COUNT; e++)
+                available[e] = pc.fds[t][e] >= 0 ? 1 : 0;
+            printPerfRow("t" + std::to_string(t), available, pc.values[t], 0.0);
+        }
+        printPerfRow("total", total, sum, flops);
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+// Times region() under per-thread counters of a team of threads, prints "<label> time" and the report
+template <typename regionType>
+double perfRegion(const std::string& label, const int threads, const double bytes, const double flops, regionType region) {
+    perfCounters pc;
+    openPerfCounters(pc, threads);
+    startPerfCounters(pc);
+    const double start = omp_get_wtime();
+    region();
+    const double end = omp_get_wtime();
+    stopPerfCounters(pc);
+    std::cout << label << " time: " << end - start << " sec" << std::endl;
+    printPerfCounters(pc, end - start, bytes, flops);
+    closePerfCounters(pc);
+    return end - start;
+}
+
+// Peak resident set of the process so far
+void printPeakRss() {
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        std::cout << "Peak RSS: " << usage.ru_maxrss / 1024 << " MB" << std::endl;
+}
@@ -0,0 +1,108 @@
+// Parallel primitives: work-group scan, multi-pass global scan, stream compaction and LSD radix sort.
+// WG_SIZE is the power of two work-group size the host launches every kernel with.
+#ifndef WG_SIZE
+#define WG_SIZE 256
+#endif
+#define RADIX_DIGITS 16
+
+// Blelloch exclusive scan of data[0, WG_SIZE) in place, returns the total. Every work-item of the group must call it.
+uint localExclusiveScan(__local uint *data, const uint lid) {
+    uint offset = 1;
+    for (uint d = WG_SIZE >> 1; d > 0; d >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d)
+            data[offset * (2 * lid + 2) - 1] += data[offset * (2 * lid + 1) - 1];
+        offset <<= 1;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    const uint total = data[WG_SIZE - 1];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == 0)
+        data[WG_SIZE - 1] = 0;
+    for (uint d = 1; d < WG_SIZE; d <<= 1) {
+        offset >>= 1;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d) {
+            const uint ai = offset * (2 * lid + 1) - 1;
+            const uint bi = offset * (2 * lid + 2) - 1;
+            const uint t = data[ai];
+            data[ai] = data[bi];
+            data[bi] += t;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return total;
+}
+
+// Scans each WG_SIZE block of in and stores the block totals; in and out may be the same buffer
+__kernel void scanBlocks(__global const uint *in, __global uint *out, __global uint *blockSums, const uint n, const int inclusive) {
+    __local uint data[WG_SIZE];
+    const uint lid = get_local_id(0);
+    const uint i = get_global_id(0);
+    const uint value = i < n ? in[i] : 0;
+    data[lid] = value;
+    const uint total = localExclusiveScan(data, lid);
+    if (i < n)
+        out[i] = data[lid] + (inclusive ? value : 0);
+    if (lid == 0)
+        blockSums[get_group_id(0)] = total;
+}
+
+// offsets holds the exclusive scan of the block totals
+__kernel void addBlockOffsets(__global uint *out, __global const uint *offsets, const uint n) {
+    const uint i = get_global_id(0);
+    if (i < n)
+        out[i] += offsets[get_group_id(0)];
+}
+
+__kernel void compactFlags(__global const float *in, __global uint *flags, const uint n) {
+    const uint i = get_global_id(0);
+    if (i < n)
+        flags[i] = in[i] != 0.0f;
+}
+
+// positions is the exclusive scan of flags, so kept elements keep their order
+__kernel void compactScatter(__global const float *in, __global const uint *flags, __global const uint *positions,
+                             __global float *values, __global uint *indices, const uint n) {
+    const uint i = get_global_id(0);
+    if (i < n && flags[i]) {
+        values[positions[i]] = in[i];
+        indices[positions[i]] = i;
+    }
+}
+
+// Digit counts of every group, digit major (histogram[digit * groups + group]) so one exclusive scan yields the scatter bases
+__kernel void radixHistogram(__global const uint *keys, __global uint *histogram, const uint n, const uint shift) {
+    __local uint counts[RADIX_DIGITS];
+    const uint lid = get_local_id(0);
+    const uint i = get_global_id(0);
+    if (lid < RADIX_DIGITS)
+        counts[lid] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (i < n)
+        atomic_inc(&counts[(keys[i] >> shift) & (RADIX_DIGITS - 1)]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < RADIX_DIGITS)
+        histogram[lid * get_num_groups(0) + get_group_id(0)] = counts[lid];
+}
+
+// Each key is ranked among the keys of its group with the same digit, which keeps the pass stable
+__kernel void radixScatter(__global const uint *keysIn, __global uint *keysOut, __global const uint *valuesIn, __global uint *valuesOut,
+                           __global const uint *offsets, const uint n, const uint shift, const int withValues) {
+    __local uint data[WG_SIZE];
+    const uint lid = get_local_id(0);
+    const uint i = get_global_id(0);
+    const uint digit = i < n ? (keysIn[i] >> shift) & (RADIX_DIGITS - 1) : RADIX_DIGITS;
+    uint position = 0;
+    for (uint d = 0; d < RADIX_DIGITS; d++) {
+        data[lid] = digit == d;
+        localExclusiveScan(data, lid);
+        if (digit == d)
+            position = offsets[d * get_num_groups(0) + get_group_id(0)] + data[lid];
+    }
+    if (i < n) {
+        keysOut[position] = keysIn[i];
+        if (withValues)
+            valuesOut[position] = valuesIn[i];
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "opencl_utils.hpp"
+#include "primitives_cl.hpp"
+
+// Device side of the scan, compaction and radix sort kernels in primitives.cl. The global scan is multi-pass:
+// blocks are scanned, their totals scanned recursively and added back. A decoupled look-back single pass scan
+// would need forward progress guarantees between work-groups that OpenCL 1.2 doesn't give.
+
+struct primitives {
+    cl_context context{};
+    cl_device_id device{};
+    cl_command_queue queue{};
+    cl_program program{};
+    cl_kernel scanBlocks{}, addBlockOffsets{}, compactFlags{}, compactScatter{}, radixHistogram{}, radixScatter{};
+    size_t wgSize{};
+};
+
+void getPrimitivesKernelText(std::vector<char>& kernelText) {
+    kernelText.assign(primitivesSource, primitivesSource + sizeof(primitivesSource));
+}
+
+void createPrimitives(const deviceInfo& info, primitives& p) {
+    p.device = info.device;
+    p.wgSize = 256;
+    while (p.wgSize > 16 && p.wgSize > info.maxWorkGroupSize)
+        p.wgSize /= 2;
+    createContext(info.platform, info.device, p.context);
+    createQueue(p.context, info.device, p.queue);
+    std::vector<char> kernelText;
+    getPrimitivesKernelText(kernelText);
+    buildProgram(p.context, info.device, kernelText, "-DWG_SIZE=" + std::to_string(p.wgSize), p.program);
+    createKernel(p.program, p.scanBlocks, "scanBlocks");
+    createKernel(p.program, p.addBlockOffsets, "addBlockOffsets");
+    createKernel(p.program, p.compactFlags, "compactFlags");
+    createKernel(p.program, p.compactScatter, "compactScatter");
+    createKernel(p.program, p.radixHistogram, "radixHistogram");
+    createKernel(p.program, p.radixScatter, "radixScatter");
+}
+
+void releasePrimitives(primitives& p) {
+    cl_kernel kernels[6]{ p.scanBlocks, p.addBlockOffsets, p.compactFlags, p.compactScatter, p.radixHistogram, p.radixScatter };
+    for (size_t i = 0; i < 6; i++)
+        clReleaseKernel(kernels[i]);
+    clReleaseProgram(p.program);
+    clReleaseCommandQueue(p.queue);
+    clReleaseContext(p.context);
+}
+
+cl_mem createUintBuffer(const primitives& p, const size_t count) {
+    cl_int retCode;
+    cl_mem buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(cl_uint) * std::max<size_t>(count, 1), NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create primitives buffer");
+    return buffer;
+}
+
+// Sets args in order, each entry is a (size, pointer) pair
+void setPrimitiveArgs(const cl_kernel& kernel, const std::vector<std::pair<size_t, const void*>>& args) {
+    for (size_t i = 0; i < args.size(); i++) {
+        if (clSetKernelArg(kernel, static_cast<cl_uint>(i), args[i].first, args[i].second) != CL_SUCCESS)
+            throw std::runtime_error("Can't set primitives kernel arg " + std::to_string(i));
+    }
+}
+
+void enqueuePrimitive(const primitives& p, const cl_kernel& kernel, const size_t groups) {
+    const size_t globalWorkSize = groups * p.wgSize;
+    if (clEnqueueNDRangeKernel(p.queue, kernel, 1, NULL, &globalWorkSize, &p.wgSize, 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't run primitives kernel execution");
+}
+
+size_t groupCount(const primitives& p, const size_t n) {
+    return (n + p.wgSize - 1) / p.wgSize;
+}
+
+// Prefix sum of n uints enqueued on p.queue, in and out may be the same buffer
+void deviceScan(const primitives& p, const cl_mem& in, const cl_mem& out, const cl_uint n, const bool inclusive) {
+    if (n == 0)
+        return;
+    const size_t groups = groupCount(p, n);
+    const cl_int inclusiveArg = inclusive ? 1 : 0;
+    cl_mem blockSums = createUintBuffer(p, groups);
+    setPrimitiveArgs(p.scanBlocks, { { sizeof(cl_mem), &in }, { sizeof(cl_mem), &out }, { sizeof(cl_mem), &blockSums },
+                                     { sizeof(cl_uint), &n }, { sizeof(cl_int), &inclusiveArg } });
+    enqueuePrimitive(p, p.scanBlocks, groups);
+    if (groups > 1) {
+        deviceScan(p, blockSums, blockSums, static_cast<cl_uint>(groups), false);
+        setPrimitiveArgs(p.addBlockOffsets, { { sizeof(cl_mem), &out }, { sizeof(cl_mem), &blockSums }, { sizeof(cl_uint), &n } });
+        enqueuePrimitive(p, p.addBlockOffsets, groups);
+    }
+    // released once the queued kernels are done with it
+    clReleaseMemObject(blockSums);
+}
+
+// Keeps the non-zero floats of in with their indices, in order. values and indices must hold n elements.
+cl_uint deviceCompact(const primitives& p, const cl_mem& in, const cl_uint n, const cl_mem& values, const cl_mem& indices) {
+    if (n == 0)
+        return 0;
+    const size_t groups = groupCount(p, n);
+    cl_mem flags = createUintBuffer(p, n);
+    cl_mem positions = createUintBuffer(p, n);
+    setPrimitiveArgs(p.compactFlags, { { sizeof(cl_mem), &in }, { sizeof(cl_mem), &flags }, { sizeof(cl_uint), &n } });
+    enqueuePrimitive(p, p.compactFlags, groups);
+    deviceScan(p, flags, positions, n, false);
+    setPrimitiveArgs(p.compactScatter, { { sizeof(cl_mem), &in }, { sizeof(cl_mem), &flags }, { sizeof(cl_mem), &positions },
+                                         { sizeof(cl_mem), &values }, { sizeof(cl_mem), &indices }, { sizeof(cl_uint), &n } });
+    enqueuePrimitive(p, p.compactScatter, groups);
+
+    cl_uint last[2]{};
+    if (clEnqueueReadBuffer(p.queue, positions, CL_TRUE, sizeof(cl_uint) * (n - 1), sizeof(cl_uint), &last[0], 0, NULL, NULL) != CL_SUCCESS ||
+        clEnqueueReadBuffer(p.queue, flags, CL_TRUE, sizeof(cl_uint) * (n - 1), sizeof(cl_uint), &last[1], 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read compaction count");
+    clReleaseMemObject(flags);
+    clReleaseMemObject(positions);
+    return last[0] + last[1];
+}
+
+// LSD radix sort of 32-bit keys, 4 bits per pass; values (may be null) are permuted along. The 8 passes
+// ping-pong through scratch buffers and end in keys/values again.
+void deviceRadixSort(const primitives& p, const cl_mem& keys, const cl_mem& values, const cl_uint n) {
+    if (n == 0)
+        return;
+    const size_t groups = groupCount(p, n);
+    const cl_int withValues = values != nullptr ? 1 : 0;
+    cl_mem histogram = createUintBuffer(p, 16 * groups);
+    cl_mem keysTmp = createUintBuffer(p, n);
+    cl_mem valuesTmp = withValues ? createUintBuffer(p, n) : keysTmp;
+    const cl_mem valuesIn = withValues ? values : keys;
+    cl_mem src[2]{ keys, valuesIn };
+    cl_mem dst[2]{ keysTmp, valuesTmp };
+    const cl_uint histogramSize = static_cast<cl_uint>(16 * groups);
+    for (cl_uint shift = 0; shift < 32; shift += 4) {
+        setPrimitiveArgs(p.radixHistogram, { { sizeof(cl_mem), &src[0] }, { sizeof(cl_mem), &histogram }, { sizeof(cl_uint), &n },
+                                             { sizeof(cl_uint), &shift } });
+        enqueuePrimitive(p, p.radixHistogram, groups);
+        deviceScan(p, histogram, histogram, histogramSize, false);
+        setPrimitiveArgs(p.radixScatter, { { sizeof(cl_mem), &src[0] }, { sizeof(cl_mem), &dst[0] }, { sizeof(cl_mem), &src[1] },
+                                           { sizeof(cl_mem), &dst[1] }, { sizeof(cl_mem), &histogram }, { sizeof(cl_uint), &n },
+                                           { sizeof(cl_uint), &shift }, { sizeof(cl_int), &withValues } });
+        enqueuePrimitive(p, p.radixScatter, groups);
+        std::swap(src[0], dst[0]);
+        std::swap(src[1], dst[1]);
+    }
+    clFinish(p.queue);
+    clReleaseMemObject(histogram);
+    clReleaseMemObject(keysTmp);
+    if (withValues)
+        clReleaseMemObject(valuesTmp);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <omp.h>
+#include <cstdint>
+#include <vector>
+
+// Open MP counterparts of primitives.cl: every thread owns one contiguous chunk, per-chunk totals are
+// combined serially between two parallel passes.
+
+namespace host {
+
+void scan(const uint32_t* in, uint32_t* out, const size_t n, const bool inclusive) {
+    std::vector<uint32_t> sums;
+#pragma omp parallel num_threads(8)
+    {
+        const size_t tid = static_cast<size_t>(omp_get_thread_num());
+        const size_t nthreads = static_cast<size_t>(omp_get_num_threads());
+#pragma omp single
+        sums.assign(nthreads + 1, 0);
+        const size_t begin = n * tid / nthreads;
+        const size_t end = n * (tid + 1) / nthreads;
+        uint32_t sum = 0;
+        for (size_t i = begin; i < end; i++)
+            sum += in[i];
+        sums[tid + 1] = sum;
+#pragma omp barrier
+#pragma omp single
+        for (size_t t = 1; t <= nthreads; t++)
+            sums[t] += sums[t - 1];
+        sum = sums[tid];
+        for (size_t i = begin; i < end; i++) {
+            const uint32_t value = in[i];
+            out[i] = inclusive ? sum + value : sum;
+            sum += value;
+        }
+    }
+}
+
+// Non-zero elements of in with their indices, in order
+void compact(const float* in, const size_t n, std::vector<float>& values, std::vector<uint32_t>& indices) {
+    std::vector<size_t> counts;
+#pragma omp parallel num_threads(8)
+    {
+        const size_t tid = static_cast<size_t>(omp_get_thread_num());
+        const size_t nthreads = static_cast<size_t>(omp_get_num_threads());
+#pragma omp single
+        counts.assign(nthreads + 1, 0);
+        const size_t begin = n * tid / nthreads;
+        const size_t end = n * (tid + 1) / nthreads;
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++)
+            count += in[i] != 0.0f;
+        counts[tid + 1] = count;
+#pragma omp barrier
+#pragma omp single
+        {
+            for (size_t t = 1; t <= nthreads; t++)
+                counts[t] += counts[t - 1];
+            values.resize(counts[nthreads]);
+            indices.resize(counts[nthreads]);
+        }
+        size_t position = counts[tid];
+        for (size_t i = begin; i < end; i++) {
+            if (in[i] != 0.0f) {
+                values[position] = in[i];
+                indices[position] = static_cast<uint32_t>(i);
+                position++;
+            }
+        }
+    }
+}
+
+// LSD radix sort, 8 bits per pass with per-thread digit histograms; values (may be null) are permuted along
+void radixSort(uint32_t* keys, uint32_t* values, const size_t n) {
+    std::vector<uint32_t> keysTmp(n), valuesTmp(values != nullptr ? n : 0);
+    uint32_t* src[2]{ keys, values };
+    uint32_t* dst[2]{ keysTmp.data(), values != nullptr ? valuesTmp.data() : nullptr };
+    std::vector<size_t> offsets;
+    for (int shift = 0; shift < 32; shift += 8) {
+#pragma omp parallel num_threads(8)
+        {
+            const size_t tid = static_cast<size_t>(omp_get_thread_num());
+            const size_t nthreads = static_cast<size_t>(omp_get_num_threads());
+#pragma omp single
+            offsets.assign(256 * nthreads, 0);
+            const size_t begin = n * tid / nthreads;
+            const size_t end = n * (tid + 1) / nthreads;
+            size_t* counts = &offsets[256 * tid];
+            for (size_t i = begin; i < end; i++)
+                counts[(src[0][i] >> shift) & 0xFF]++;
+#pragma omp barrier
+            // digit major exclusive scan: every thread's bucket follows the same digit of lower threads
+#pragma omp single
+            {
+                size_t sum = 0;
+                for (size_t digit = 0; digit < 256; digit++) {
+                    for (size_t t = 0; t < nthreads; t++) {
+                        const size_t count = offsets[256 * t + digit];
+                        offsets[256 * t + digit] = sum;
+                        sum += count;
+                    }
+                }
+            }
+            for (size_t i = begin; i < end; i++) {
+                const size_t position = counts[(src[0][i] >> shift) & 0xFF]++;
+                dst[0][position] = src[0][i];
+                if (src[1] != nullptr)
+                    dst[1][position] = src[1][i];
+            }
+        }
+        std::swap(src[0], dst[0]);
+        std::swap(src[1], dst[1]);
+    }
+}
+
+}
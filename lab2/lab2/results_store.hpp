@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "random_utils.hpp"
+
+// Benchmark results appended to a CSV store (one row per kernel, shape and run, raw samples kept) and a
+// comparison of two revisions: a variant regresses when the bootstrap confidence interval of the ratio of
+// median times lies entirely above 1 + tolerance, so noisy variants need a larger slowdown to be flagged.
+
+struct benchmarkResult {
+    std::string revision;
+    std::string timestamp;
+    std::string device;
+    std::string driver;
+    std::string kernel;
+    std::string shape;
+    std::vector<double> samples;
+};
+
+const char* const RESULTS_HEADER = "revision,timestamp,device,driver,kernel,shape,count,median,mean,stddev,min,max,samples";
+
+double median(std::vector<double> values) {
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    const size_t mid = values.size() / 2;
+    return values.size() % 2 != 0 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+}
+
+// $LABS_REVISION, else git describe of the working tree (with -dirty), else "unknown"
+std::string currentRevision() {
+    if (const char* revision = std::getenv("LABS_REVISION"))
+        return revision;
+    std::string revision;
+    if (FILE* pipe = popen("git describe --always --dirty 2>/dev/null", "r")) {
+        char buffer[128];
+        while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+            revision += buffer;
+        pclose(pipe);
+    }
+    revision.erase(std::remove(revision.begin(), revision.end(), '\n'), revision.end());
+    return revision.empty() ? "unknown" : revision;
+}
+
+std::string currentTimestamp() {
+    char buffer[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    return buffer;
+}
+
+std::string csvField(const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos)
+        return value;
+    std::string quoted = "\"";
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '"')
+            quoted += '"';
+        quoted += value[i];
+    }
+    return quoted + "\"";
+}
+
+void splitCsv(const std::string& line, std::vector<std::string>& fields) {
+    fields.assign(1, "");
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (quoted && line[i] == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+            fields.back() += '"';
+            i++;
+        } else if (line[i] == '"') {
+            quoted = !quoted;
+        } else if (line[i] == ',' && !quoted) {
+            fields.push_back("");
+        } else {
+            fields.back() += line[i];
+        }
+    }
+}
+
+void appendResults(const std::string& path, const std::vector<benchmarkResult>& results) {
+    std::ifstream existing(path);
+    const bool header = !existing.good() || existing.peek() == std::ifstream::traits_type::eof();
+    existing.close();
+
+    std::ofstream desc(path, std::ios_base::app);
+    if (!desc)
+        throw std::runtime_error("Can't open results file " + path);
+    if (header)
+        desc << RESULTS_HEADER << "\n";
+    desc << std::setprecision(9);
+    for (size_t i = 0; i < results.size(); i++) {
+        const benchmarkResult& r = results[i];
+        if (r.samples.empty())
+            continue;
+        double sum = 0.0, sumSq = 0.0;
+        for (size_t j = 0; j < r.samples.size(); j++) {
+            sum += r.samples[j];
+            sumSq += r.samples[j] * r.samples[j];
+        }
+        const double mean = sum / r.samples.size();
+        const double variance = r.samples.size() > 1 ? (sumSq - sum * mean) / (r.samples.size() - 1) : 0.0;
+        desc << csvField(r.revision) << "," << csvField(r.timestamp) << "," << csvField(r.device) << "," << csvField(r.driver) << ","
+            << csvField(r.kernel) << "," << csvField(r.shape) << "," << r.samples.size() << "," << median(r.samples) << "," << mean << ","
+            << std::sqrt(std::max(variance, 0.0)) << "," << *std::min_element(r.samples.begin(), r.samples.end()) << ","
+            << *std::max_element(r.samples.begin(), r.samples.end()) << ",";
+        for (size_t j = 0; j < r.samples.size(); j++)
+            desc << (j != 0 ? ";" : "") << r.samples[j];
+        desc << "\n";
+    }
+    if (!desc)
+        throw std::runtime_error("Can't write results file " + path);
+}
+
+void loadResults(const std::string& path, std::vector<benchmarkResult>& results) {
+    results.clear();
+    std::ifstream desc(path);
+    if (!desc)
+        throw std::runtime_error("Can't open results file " + path);
+    std::string line;
+    std::vector<std::string> fields;
+    while (std::getline(desc, line)) {
+        if (line.empty() || line == RESULTS_HEADER)
+            continue;
+        splitCsv(line, fields);
+        if (fields.size() != 13)
+            throw std::runtime_error("Malformed results line: " + line);
+        benchmarkResult r;
+        r.revision = fields[0];
+        r.timestamp = fields[1];
+        r.device = fields[2];
+        r.driver = fields[3];
+        r.kernel = fields[4];
+        r.shape = fields[5];
+        std::istringstream samples(fields[12]);
+        std::string sample;
+        while (std::getline(samples, sample, ';'))
+            r.samples.push_back(std::stod(sample));
+        results.push_back(r);
+    }
+}
+
+// Percentile bootstrap of median(candidate) / median(baseline); indices come from the counter-based rng, so
+// the interval is reproducible
+void bootstrapMedianRatio(const std::vector<double>& baseline, const std::vector<double>& candidate, const size_t resamples,
+                          const uint64_t& seed, double& low, double& high) {
+    std::vector<double> ratios(resamples);
+    std::vector<double> b(baseline.size()), c(candidate.size());
+    uint64_t block = 0;
+    uint32_t r[4];
+    int lane = 4;
+    for (size_t i = 0; i < resamples; i++) {
+        for (size_t j = 0; j < b.size() + c.size(); j++) {
+            if (lane == 4) {
+                rng::philox4x32(block++, seed, r);
+                lane = 0;
+            }
+            if (j < b.size())
+                b[j] = baseline[rng::toUniformInt(r[lane++], 0, static_cast<int>(baseline.size()) - 1)];
+            else
+                c[j - b.size()] = candidate[rng::toUniformInt(r[lane++], 0, static_cast<int>(candidate.size()) - 1)];
+        }
+        ratios[i] = median(c) / median(b);
+    }
+    std::sort(ratios.begin(), ratios.end());
+    low = ratios[static_cast<size_t>(0.025 * (resamples - 1))];
+    high = ratios[static_cast<size_t>(0.975 * (resamples - 1))];
+}
+
+// Compares every (device, kernel, shape) present in both revisions, samples of repeated runs are pooled.
+// Returns the number of regressions.
+size_t compareRevisions(const std::vector<benchmarkResult>& results, const std::string& baseline, const std::string& candidate,
+                        const double tolerance = 0.02) {
+    typedef std::map<std::string, std::vector<double>> samplesByKey;
+    samplesByKey base, cand;
+    for (size_t i = 0; i < results.size(); i++) {
+        const std::string key = results[i].device + " | " + results[i].kernel + " | " + results[i].shape;
+        const std::vector<double>& samples = results[i].samples;
+        if (results[i].revision == baseline)
+            base[key].insert(base[key].end(), samples.begin(), samples.end());
+        else if (results[i].revision == candidate)
+            cand[key].insert(cand[key].end(), samples.begin(), samples.end());
+    }
+
+    size_t regressions = 0;
+    const std::ios_base::fmtflags flags = std::cout.flags();
+    const std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << "Baseline " << baseline << ", candidate " << candidate << std::endl;
+    size_t missing = 0;
+    for (samplesByKey::const_iterator it = base.begin(); it != base.end(); ++it) {
+        samplesByKey::const_iterator other = cand.find(it->first);
+        // a dropped or renamed variant must not read as "no regression"
+        if (other == cand.end() || other->second.empty()) {
+            std::cout << "\t" << it->first << ": missing in candidate" << std::endl;
+            missing++;
+            continue;
+        }
+        if (it->second.empty())
+            continue;
+        double low = 0.0, high = 0.0;
+        bootstrapMedianRatio(it->second, other->second, 2000, 37, low, high);
+        const double ratio = median(other->second) / median(it->second);
+        std::string verdict = "same";
+        if (low > 1.0 + tolerance) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (high < 1.0 - tolerance) {
+            verdict = "improvement";
+        }
+        std::cout << "\t" << it->first << ": " << std::setprecision(6) << median(it->second) << " -> " << median(other->second)
+            << " sec, x" << std::setprecision(3) << ratio << " [" << low << ", " << high << "] " << verdict << std::endl;
+    }
+    for (samplesByKey::const_iterator it = cand.begin(); it != cand.end(); ++it) {
+        if (!it->second.empty() && base.find(it->first) == base.end()) {
+            std::cout << "\t" << it->first << ": missing in baseline" << std::endl;
+            missing++;
+        }
+    }
+    std::cout << regressions << " regression(s), " << missing << " variant(s) in only one revision" << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+    return regressions;
+}
+
+// lab --compare <baseline> [candidate]: candidate defaults to the current revision, exit code 1 on regressions
+int runCompare(int argc, char* argv[], const std::string& path) {
+    try {
+        std::vector<benchmarkResult> results;
+        loadResults(path, results);
+        const std::string candidate = argc > 3 ? argv[3] : currentRevision();
+        return compareRevisions(results, argv[2], candidate) == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
+
+// $LABS_RESULTS, else the given file in the working directory
+std::string resultsPath(const std::string& fileName) {
+    if (const char* path = std::getenv("LABS_RESULTS"))
+        return path;
+    return fileName;
+}
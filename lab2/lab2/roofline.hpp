@@ -0,0 +1,238 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <omp.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "opencl_utils.hpp"
+#include "stream_cl.hpp"
+
+// Roofline of a device or of the Open MP host: STREAM copy/scale/add/triad give the attainable bandwidth
+// (best of the four), peakFlops the compute ceiling. Kernels are then placed by arithmetic intensity and
+// reported as a share of min(peak FLOP/s, intensity * bandwidth). STREAM counts bytes without write allocate.
+
+struct rooflinePeak {
+    std::string name;
+    double copy{}, scale{}, add{}, triad{};
+    double bandwidth{};
+    double gflops{};
+};
+
+struct rooflinePoint {
+    std::string name;
+    double flops{};
+    double bytes{};
+    double seconds{};
+};
+
+const int STREAM_REPEATS = 5;
+const int PEAK_ITERATIONS = 4096;
+
+void getStreamKernelText(std::vector<char>& kernelText) {
+    kernelText.assign(streamSource, streamSource + sizeof(streamSource));
+}
+
+// Best of STREAM_REPEATS runs of a 1D kernel, in seconds
+double timeKernel(const cl_command_queue& queue, const cl_kernel& kernel, const size_t globalWorkSize) {
+    double best = 0.0;
+    for (int r = 0; r < STREAM_REPEATS; r++) {
+        double start = omp_get_wtime();
+        if (clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't run kernel execution");
+        if (clFinish(queue) != CL_SUCCESS)
+            throw std::runtime_error("Can't finish kernel execution");
+        double end = omp_get_wtime();
+        if (r == 0 || end - start < best)
+            best = end - start;
+    }
+    return best;
+}
+
+void setKernelArgs(const cl_kernel& kernel, const std::vector<cl_mem>& buffers, const float* q, const unsigned int n) {
+    cl_uint arg = 0;
+    for (size_t i = 0; i < buffers.size(); i++, arg++) {
+        if (clSetKernelArg(kernel, arg, sizeof(cl_mem), &buffers[i]) != CL_SUCCESS)
+            throw std::runtime_error("Can't set stream kernel arg " + std::to_string(arg));
+    }
+    if (q != nullptr && clSetKernelArg(kernel, arg++, sizeof(float), q) != CL_SUCCESS)
+        throw std::runtime_error("Can't set stream kernel arg " + std::to_string(arg));
+    if (clSetKernelArg(kernel, arg, sizeof(unsigned int), &n) != CL_SUCCESS)
+        throw std::runtime_error("Can't set stream kernel arg " + std::to_string(arg));
+}
+
+// n floats per array, clamped so the three arrays fit the device
+void measureDevicePeak(const deviceInfo& info, size_t n, rooflinePeak& peak) {
+    n = std::min<size_t>(n, info.maxAllocSize / sizeof(float));
+    n = std::min<size_t>(n, info.globalMemSize / (4 * sizeof(float)));
+    peak = rooflinePeak();
+    peak.name = info.name;
+
+    cl_context context{};
+    createContext(info.platform, info.device, context);
+    cl_command_queue queue{};
+    createQueue(context, info.device, queue);
+    std::vector<char> kernelText;
+    getStreamKernelText(kernelText);
+    cl_program program{};
+    buildProgram(context, info.device, kernelText, "", program);
+    const char* names[5]{ "streamCopy", "streamScale", "streamAdd", "streamTriad", "peakFlops" };
+    cl_kernel kernels[5]{};
+    for (int i = 0; i < 5; i++) {
+        cl_int retCode;
+        kernels[i] = clCreateKernel(program, names[i], &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error(std::string("Can't create kernel ") + names[i]);
+    }
+
+    cl_mem a{}, b{}, c{};
+    cl_mem* arrays[3]{ &a, &b, &c };
+    const float init[3]{ 1.0f, 2.0f, 0.0f };
+    for (int i = 0; i < 3; i++) {
+        cl_int retCode;
+        *arrays[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * n, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create stream buffer");
+        if (clEnqueueFillBuffer(queue, *arrays[i], &init[i], sizeof(float), 0, sizeof(float) * n, 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't fill stream buffer");
+    }
+
+    const float q = 3.0f;
+    const unsigned int count = static_cast<unsigned int>(n);
+    const size_t globalWorkSize = (n + 255) / 256 * 256;
+    const double bytes = sizeof(float) * static_cast<double>(n);
+    setKernelArgs(kernels[0], { a, c }, nullptr, count);
+    peak.copy = 2 * bytes / timeKernel(queue, kernels[0], globalWorkSize) * 1e-9;
+    setKernelArgs(kernels[1], { b, c }, &q, count);
+    peak.scale = 2 * bytes / timeKernel(queue, kernels[1], globalWorkSize) * 1e-9;
+    setKernelArgs(kernels[2], { a, b, c }, nullptr, count);
+    peak.add = 3 * bytes / timeKernel(queue, kernels[2], globalWorkSize) * 1e-9;
+    setKernelArgs(kernels[3], { a, b, c }, &q, count);
+    peak.triad = 3 * bytes / timeKernel(queue, kernels[3], globalWorkSize) * 1e-9;
+    peak.bandwidth = std::max(std::max(peak.copy, peak.scale), std::max(peak.add, peak.triad));
+
+    // enough work-items to fill every compute unit several times over
+    const size_t items = std::min<size_t>(static_cast<size_t>(info.computeUnits) * info.maxWorkGroupSize * 8, n);
+    const int iterations = PEAK_ITERATIONS;
+    const float m = 0.999f;
+    if (clSetKernelArg(kernels[4], 0, sizeof(cl_mem), &c) != CL_SUCCESS ||
+        clSetKernelArg(kernels[4], 1, sizeof(int), &iterations) != CL_SUCCESS ||
+        clSetKernelArg(kernels[4], 2, sizeof(float), &m) != CL_SUCCESS)
+        throw std::runtime_error("Can't set peakFlops args");
+    peak.gflops = 64.0 * iterations * items / timeKernel(queue, kernels[4], items) * 1e-9;
+
+    for (int i = 0; i < 3; i++)
+        clReleaseMemObject(*arrays[i]);
+    for (int i = 0; i < 5; i++)
+        clReleaseKernel(kernels[i]);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+void measureHostPeak(const int threads, const size_t n, rooflinePeak& peak) {
+    peak = rooflinePeak();
+    peak.name = "Open MP host (" + std::to_string(threads) + " threads)";
+    std::vector<float> a(n), b(n), c(n);
+    float* pa = a.data();
+    float* pb = b.data();
+    float* pc = c.data();
+    const long long count = static_cast<long long>(n);
+    const float q = 3.0f;
+    // first touch by the threads that stream the arrays later
+#pragma omp parallel for num_threads(threads)
+    for (long long i = 0; i < count; i++) {
+        pa[i] = 1.0f;
+        pb[i] = 2.0f;
+        pc[i] = 0.0f;
+    }
+
+    double best[4]{};
+    for (int r = 0; r < STREAM_REPEATS; r++) {
+        double times[5]{};
+        times[0] = omp_get_wtime();
+#pragma omp parallel for num_threads(threads)
+        for (long long i = 0; i < count; i++)
+            pc[i] = pa[i];
+        times[1] = omp_get_wtime();
+#pragma omp parallel for num_threads(threads)
+        for (long long i = 0; i < count; i++)
+            pb[i] = q * pc[i];
+        times[2] = omp_get_wtime();
+#pragma omp parallel for num_threads(threads)
+        for (long long i = 0; i < count; i++)
+            pc[i] = pa[i] + pb[i];
+        times[3] = omp_get_wtime();
+#pragma omp parallel for num_threads(threads)
+        for (long long i = 0; i < count; i++)
+            pa[i] = pb[i] + q * pc[i];
+        times[4] = omp_get_wtime();
+        for (int k = 0; k < 4; k++) {
+            if (r == 0 || times[k + 1] - times[k] < best[k])
+                best[k] = times[k + 1] - times[k];
+        }
+    }
+    const double bytes = sizeof(float) * static_cast<double>(n);
+    peak.copy = 2 * bytes / best[0] * 1e-9;
+    peak.scale = 2 * bytes / best[1] * 1e-9;
+    peak.add = 3 * bytes / best[2] * 1e-9;
+    peak.triad = 3 * bytes / best[3] * 1e-9;
+    peak.bandwidth = std::max(std::max(peak.copy, peak.scale), std::max(peak.add, peak.triad));
+
+    // 64 independent mad chains per thread, as peakFlops, vectorized by the simd loop
+    const int lanes = 64;
+    const long long iterations = 1 << 20;
+    const float m = 0.999f;
+    double start = omp_get_wtime();
+#pragma omp parallel num_threads(threads)
+    {
+        float x[lanes];
+        for (int j = 0; j < lanes; j++)
+            x[j] = static_cast<float>(omp_get_thread_num() + j);
+        for (long long i = 0; i < iterations; i++) {
+#pragma omp simd
+            for (int j = 0; j < lanes; j++)
+                x[j] = x[j] * m + (1.0f - m);
+        }
+        float sum = 0.0f;
+        for (int j = 0; j < lanes; j++)
+            sum += x[j];
+        pc[omp_get_thread_num() % count] = sum;
+    }
+    double end = omp_get_wtime();
+    peak.gflops = 2.0 * lanes * iterations * threads / (end - start) * 1e-9;
+}
+
+void printPeak(const rooflinePeak& peak) {
+    const std::ios_base::fmtflags flags = std::cout.flags();
+    const std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(1) << peak.name << std::endl;
+    std::cout << "\tcopy: " << peak.copy << " GB/s, scale: " << peak.scale << " GB/s, add: " << peak.add
+        << " GB/s, triad: " << peak.triad << " GB/s" << std::endl;
+    std::cout << "\tpeak: " << peak.gflops << " GFLOP/s, ridge point: " << std::setprecision(2) << peak.gflops / peak.bandwidth
+        << " FLOP/byte" << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+void printRoofline(const rooflinePeak& peak, const std::vector<rooflinePoint>& points) {
+    const std::ios_base::fmtflags flags = std::cout.flags();
+    const std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed;
+    for (size_t i = 0; i < points.size(); i++) {
+        const rooflinePoint& p = points[i];
+        const double intensity = p.flops / p.bytes;
+        const double attainable = std::min(peak.gflops, intensity * peak.bandwidth);
+        const double achieved = p.flops / p.seconds * 1e-9;
+        std::cout << "\t" << std::left << std::setw(24) << p.name << std::right << std::setprecision(3)
+            << " AI: " << intensity << " FLOP/byte, " << std::setprecision(2) << achieved << " of " << attainable
+            << " GFLOP/s (" << std::setprecision(1) << 100.0 * achieved / attainable << "%, "
+            << (intensity * peak.bandwidth < peak.gflops ? "memory" : "compute") << " bound)" << std::endl;
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
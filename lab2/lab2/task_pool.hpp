@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for host compute: every worker pops its own deque from the back (newest, still cache
+// warm) and, when that is empty, steals from the front of the others. A core that is slow or preempted only
+// delays the tasks it is running, the rest of its queue is taken over. A thread waiting on a task group
+// runs tasks too, so the host side of a hybrid run and the waiter share the same workers. Tasks must not throw.
+
+struct taskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+};
+
+struct taskGroup {
+    std::atomic<size_t> remaining{ 0 };
+};
+
+struct taskPool {
+    std::vector<std::unique_ptr<taskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{ 0 };
+    std::atomic<size_t> steals{ 0 };
+    std::atomic<bool> stop{ false };
+    std::atomic<size_t> next{ 0 };
+
+    ~taskPool();
+};
+
+// Worker index of the calling thread in currentTaskPool, external threads have none
+thread_local taskPool* currentTaskPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+// Own queue first (LIFO), then the others starting after self (FIFO); self == queues.size() steals only
+bool takeTask(taskPool& pool, const size_t self, std::function<void()>& task) {
+    const size_t count = pool.queues.size();
+    if (self < count) {
+        taskQueue& own = *pool.queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pool.queued--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i <= count; i++) {
+        const size_t victim = (self + i) % count;
+        if (victim == self)
+            continue;
+        taskQueue& other = *pool.queues[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            pool.queued--;
+            pool.steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool runOneTask(taskPool& pool, const size_t self) {
+    std::function<void()> task;
+    if (!takeTask(pool, self, task))
+        return false;
+    task();
+    return true;
+}
+
+void workerLoop(taskPool& pool, const size_t self) {
+    currentTaskPool = &pool;
+    currentWorker = self;
+    while (!pool.stop) {
+        if (runOneTask(pool, self))
+            continue;
+        std::unique_lock<std::mutex> lock(pool.sleepMutex);
+        pool.wake.wait(lock, [&pool]() { return pool.stop || pool.queued > 0; });
+    }
+}
+
+void createTaskPool(const size_t threads, taskPool& pool) {
+    pool.stop = false;
+    pool.queues.clear();
+    for (size_t i = 0; i < threads; i++)
+        pool.queues.push_back(std::unique_ptr<taskQueue>(new taskQueue()));
+    for (size_t i = 0; i < threads; i++)
+        pool.workers.push_back(std::thread(workerLoop, std::ref(pool), i));
+}
+
+// Joins the workers; queued tasks are dropped, so wait for their groups first
+void releaseTaskPool(taskPool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.sleepMutex);
+        pool.stop = true;
+    }
+    pool.wake.notify_all();
+    for (size_t i = 0; i < pool.workers.size(); i++)
+        pool.workers[i].join();
+    pool.workers.clear();
+    pool.queues.clear();
+    pool.queued = 0;
+}
+
+taskPool::~taskPool() {
+    releaseTaskPool(*this);
+}
+
+// A worker pushes onto its own queue, other threads spread their tasks round robin
+void submitTask(taskPool& pool, taskGroup& group, const std::function<void()>& task) {
+    group.remaining++;
+    const size_t target = currentTaskPool == &pool ? currentWorker : pool.next++ % pool.queues.size();
+    {
+        std::lock_guard<std::mutex> lock(pool.queues[target]->mutex);
+        pool.queues[target]->tasks.push_back([task, &group]() {
+            task();
+            group.remaining--;
+        });
+        pool.queued++;
+    }
+    {
+        // taken so a worker can't miss the wake up between its check and its wait
+        std::lock_guard<std::mutex> lock(pool.sleepMutex);
+    }
+    pool.wake.notify_one();
+}
+
+void waitTaskGroup(taskPool& pool, taskGroup& group) {
+    const size_t self = currentTaskPool == &pool ? currentWorker : pool.queues.size();
+    while (group.remaining > 0) {
+        if (!runOneTask(pool, self))
+            std::this_thread::yield();
+    }
+}
+
+// body(rowBegin, rowEnd, colBegin, colEnd) per tile of a rows x cols range, blocks until every tile is done
+void parallelTiles(taskPool& pool, const size_t rows, const size_t cols, const size_t tileRows, const size_t tileCols,
+                   const std::function<void(size_t, size_t, size_t, size_t)>& body) {
+    taskGroup group;
+    for (size_t r = 0; r < rows; r += tileRows) {
+        for (size_t c = 0; c < cols; c += tileCols) {
+            const size_t rowEnd = std::min(r + tileRows, rows);
+            const size_t colEnd = std::min(c + tileCols, cols);
+            submitTask(pool, group, [&body, r, rowEnd, c, colEnd]() { body(r, rowEnd, c, colEnd); });
+        }
+    }
+    waitTaskGroup(pool, group);
+}
+
+// body(begin, end) per chunk of [0, n), blocks until every chunk is done
+void parallelChunks(taskPool& pool, const size_t n, const size_t chunk, const std::function<void(size_t, size_t)>& body) {
+    parallelTiles(pool, 1, n, 1, chunk, [&body](size_t, size_t, size_t begin, size_t end) { body(begin, end); });
+}
+
+// Shared by the host paths, as many workers as the num_threads(8) Open MP regions
+taskPool& hostTaskPool() {
+    static taskPool pool;
+    static std::once_flag created;
+    std::call_once(created, []() { createTaskPool(8, pool); });
+    return pool;
+}
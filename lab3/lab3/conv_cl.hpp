@@ -0,0 +1,101 @@
+// Generated by tools/embed_cl.py from conv.cl, do not edit
+#pragma once
+
+const char convSource[] =
+R"CLSRC(// 2D convolution lowered to GEMM. The geometry is baked in by the host (convOptions in conv_host.hpp):
+// CONV_N/C/H/W input, CONV_K/R/S filters, CONV_P/Q output, STRIDE_*, PAD_*, DIL_*, CONV_NHWC for the layout.
+// NCHW pairs with KCRS filters (out = filter x im2col), NHWC with RSCK filters (out = im2col x filter).
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE 16
+#endif
+
+#define CRS (CONV_C * CONV_R * CONV_S)
+#define PQ (CONV_P * CONV_Q)
+#ifdef CONV_NHWC
+#define GEMM_M (CONV_N * PQ)
+#define GEMM_N CONV_K
+#else
+#define GEMM_M CONV_K
+#define GEMM_N (CONV_N * PQ)
+#endif
+
+// Element (npq, crs) of the virtual im2col matrix, zero inside the padding
+float im2colValue(__global const float *in, int npq, int crs) {
+    const int n = npq / PQ;
+    const int p = npq % PQ / CONV_Q;
+    const int q = npq % CONV_Q;
+#ifdef CONV_NHWC
+    const int c = crs % CONV_C;
+    const int r = crs / CONV_C / CONV_S;
+    const int s = crs / CONV_C % CONV_S;
+#else
+    const int c = crs / (CONV_R * CONV_S);
+    const int r = crs / CONV_S % CONV_R;
+    const int s = crs % CONV_S;
+#endif
+    const int h = p * STRIDE_H - PAD_H + r * DIL_H;
+    const int w = q * STRIDE_W - PAD_W + s * DIL_W;
+    if (h < 0 || h >= CONV_H || w < 0 || w >= CONV_W)
+        return 0.0f;
+#ifdef CONV_NHWC
+    return in[((n * CONV_H + h) * CONV_W + w) * CONV_C + c];
+#else
+    return in[((n * CONV_C + c) * CONV_H + h) * CONV_W + w];
+#endif
+}
+
+// NHWC: col is (N*P*Q) x CRS for the whole batch, NCHW: col is CRS x (P*Q) for the given image
+__kernel void im2col(__global const float *in, __global float *col, const int image) {
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+#ifdef CONV_NHWC
+    if (x < CRS && y < CONV_N * PQ)
+        col[y * CRS + x] = im2colValue(in, y, x);
+#else
+    if (x < PQ && y < CRS)
+        col[y * PQ + x] = im2colValue(in, image * PQ + x, y);
+#endif
+}
+
+// Tiled GEMM as optGemm, with the im2col operand gathered from the input while filling the tile
+__kernel void implicitGemmConv(__global const float *in, __global const float *filter, __global float *out) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_global_id(1);
+    const int globalCol = get_global_id(0);
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc = 0.0f;
+
+    const int numTiles = (CRS + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledRow = BLOCK_SIZE*t + row;
+        const int tiledCol = BLOCK_SIZE*t + col;
+#ifdef CONV_NHWC
+        Asub[row][col] = globalRow < GEMM_M && tiledCol < CRS ? im2colValue(in, globalRow, tiledCol) : 0.0f;
+        Bsub[row][col] = tiledRow < CRS && globalCol < GEMM_N ? filter[tiledRow * CONV_K + globalCol] : 0.0f;
+#else
+        Asub[row][col] = globalRow < GEMM_M && tiledCol < CRS ? filter[globalRow * CRS + tiledCol] : 0.0f;
+        Bsub[row][col] = tiledRow < CRS && globalCol < GEMM_N ? im2colValue(in, globalCol, tiledRow) : 0.0f;
+#endif
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            acc += Asub[row][k] * Bsub[k][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (globalRow < GEMM_M && globalCol < GEMM_N) {
+#ifdef CONV_NHWC
+        out[globalRow * CONV_K + globalCol] = acc;
+#else
+        out[(globalCol / PQ * CONV_K + globalRow) * PQ + globalCol % PQ] = acc;
+#endif
+    }
+}
+)CLSRC";
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <omp.h>
+#include <stdexcept>
+#include <string>
+
+// Convolution geometry shared by conv.cl and the host reference. NCHW inputs use KCRS filters
+// and NHWC inputs RSCK filters, outputs keep the input layout.
+
+enum tensorLayout {
+    NCHW,
+    NHWC
+};
+
+struct convShape {
+    unsigned int n = 1, c = 1, h = 1, w = 1;
+    unsigned int k = 1, r = 1, s = 1;
+    unsigned int strideH = 1, strideW = 1;
+    unsigned int padH = 0, padW = 0;
+    unsigned int dilationH = 1, dilationW = 1;
+    tensorLayout layout = tensorLayout::NCHW;
+};
+
+unsigned int convOutHeight(const convShape& cs) {
+    const int extent = static_cast<int>(cs.h + 2 * cs.padH) - static_cast<int>(cs.dilationH * (cs.r - 1) + 1);
+    if (extent < 0 || cs.strideH == 0)
+        throw std::runtime_error("Filter doesn't fit the input height");
+    return static_cast<unsigned int>(extent) / cs.strideH + 1;
+}
+
+unsigned int convOutWidth(const convShape& cs) {
+    const int extent = static_cast<int>(cs.w + 2 * cs.padW) - static_cast<int>(cs.dilationW * (cs.s - 1) + 1);
+    if (extent < 0 || cs.strideW == 0)
+        throw std::runtime_error("Filter doesn't fit the input width");
+    return static_cast<unsigned int>(extent) / cs.strideW + 1;
+}
+
+size_t convInputSize(const convShape& cs) {
+    return static_cast<size_t>(cs.n) * cs.c * cs.h * cs.w;
+}
+
+size_t convFilterSize(const convShape& cs) {
+    return static_cast<size_t>(cs.k) * cs.c * cs.r * cs.s;
+}
+
+size_t convOutputSize(const convShape& cs) {
+    return static_cast<size_t>(cs.n) * cs.k * convOutHeight(cs) * convOutWidth(cs);
+}
+
+std::string convOptions(const convShape& cs) {
+    std::string options = " -DCONV_N=" + std::to_string(cs.n) + " -DCONV_C=" + std::to_string(cs.c) +
+        " -DCONV_H=" + std::to_string(cs.h) + " -DCONV_W=" + std::to_string(cs.w) +
+        " -DCONV_K=" + std::to_string(cs.k) + " -DCONV_R=" + std::to_string(cs.r) + " -DCONV_S=" + std::to_string(cs.s) +
+        " -DCONV_P=" + std::to_string(convOutHeight(cs)) + " -DCONV_Q=" + std::to_string(convOutWidth(cs)) +
+        " -DSTRIDE_H=" + std::to_string(cs.strideH) + " -DSTRIDE_W=" + std::to_string(cs.strideW) +
+        " -DPAD_H=" + std::to_string(cs.padH) + " -DPAD_W=" + std::to_string(cs.padW) +
+        " -DDIL_H=" + std::to_string(cs.dilationH) + " -DDIL_W=" + std::to_string(cs.dilationW);
+    if (cs.layout == tensorLayout::NHWC)
+        options += " -DCONV_NHWC";
+    return options;
+}
+
+namespace host {
+
+// Direct convolution, one output element per iteration of the parallel loop
+void conv2d(const convShape& cs, const float* in, const float* filter, float* out) {
+    const int p = static_cast<int>(convOutHeight(cs));
+    const int q = static_cast<int>(convOutWidth(cs));
+    const int n = static_cast<int>(cs.n), c = static_cast<int>(cs.c), h = static_cast<int>(cs.h), w = static_cast<int>(cs.w);
+    const int k = static_cast<int>(cs.k), r = static_cast<int>(cs.r), s = static_cast<int>(cs.s);
+    const bool nhwc = cs.layout == tensorLayout::NHWC;
+    const long long workAmount = static_cast<long long>(n) * k * p * q;
+#pragma omp parallel for num_threads(8)
+    for (long long id = 0; id < workAmount; id++) {
+        // id enumerates the output in its own layout
+        int ni, ki, pi, qi;
+        if (nhwc) {
+            ki = static_cast<int>(id % k);
+            qi = static_cast<int>(id / k % q);
+            pi = static_cast<int>(id / k / q % p);
+            ni = static_cast<int>(id / k / q / p);
+        } else {
+            qi = static_cast<int>(id % q);
+            pi = static_cast<int>(id / q % p);
+            ki = static_cast<int>(id / q / p % k);
+            ni = static_cast<int>(id / q / p / k);
+        }
+        float acc = 0.0f;
+        for (int ci = 0; ci < c; ci++) {
+            for (int ri = 0; ri < r; ri++) {
+                const int hi = pi * static_cast<int>(cs.strideH) - static_cast<int>(cs.padH) + ri * static_cast<int>(cs.dilationH);
+                if (hi < 0 || hi >= h)
+                    continue;
+                for (int si = 0; si < s; si++) {
+                    const int wi = qi * static_cast<int>(cs.strideW) - static_cast<int>(cs.padW) + si * static_cast<int>(cs.dilationW);
+                    if (wi < 0 || wi >= w)
+                        continue;
+                    if (nhwc)
+                        acc += in[((static_cast<size_t>(ni) * h + hi) * w + wi) * c + ci] * filter[((static_cast<size_t>(ri) * s + si) * c + ci) * k + ki];
+                    else
+                        acc += in[((static_cast<size_t>(ni) * c + ci) * h + hi) * w + wi] * filter[((static_cast<size_t>(ki) * c + ci) * r + ri) * s + si];
+                }
+            }
+        }
+        out[id] = acc;
+    }
+}
+
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Inventory of every OpenCL platform/device with the properties used to pick kernels and launch sizes.
+
+struct deviceInfo {
+    cl_platform_id platform{};
+    cl_device_id device{};
+    std::string platformName;
+    std::string name;
+    std::string driverVersion;
+    std::string version;
+    std::string extensions;
+    cl_device_type type{};
+    cl_uint computeUnits{};
+    size_t maxWorkGroupSize{};
+    cl_ulong localMemSize{};
+    cl_ulong globalMemSize{};
+    cl_ulong maxAllocSize{};
+    cl_uint vectorWidthHalf{};
+    cl_uint vectorWidthFloat{};
+    cl_uint vectorWidthDouble{};
+    bool fp16{};
+    bool fp64{};
+    bool imageSupport{};
+};
+
+std::string getPlatformString(const cl_platform_id& platform, const cl_platform_info param) {
+    size_t size = 0;
+    if (clGetPlatformInfo(platform, param, 0, NULL, &size) != CL_SUCCESS)
+        throw std::runtime_error("Can't get platforms info");
+    std::string value(size, '\0');
+    if (clGetPlatformInfo(platform, param, size, &value[0], NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't get platforms info");
+    value.resize(value.find('\0') == std::string::npos ? value.size() : value.find('\0'));
+    return value;
+}
+
+std::string getDeviceString(const cl_device_id& device, const cl_device_info param) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS)
+        throw std::runtime_error("Can't get device info");
+    std::string value(size, '\0');
+    if (clGetDeviceInfo(device, param, size, &value[0], NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't get device info");
+    value.resize(value.find('\0') == std::string::npos ? value.size() : value.find('\0'));
+    return value;
+}
+
+template <typename valueType>
+valueType getDeviceValue(const cl_device_id& device, const cl_device_info param) {
+    valueType value{};
+    if (clGetDeviceInfo(device, param, sizeof(valueType), &value, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't get device info " + std::to_string(param));
+    return value;
+}
+
+// "OpenCL <major>.<minor> <vendor info>" as major * 10 + minor, 0 if the string doesn't parse
+int openCLVersion(const std::string& version) {
+    int major = 0, minor = 0;
+    if (sscanf(version.c_str(), "OpenCL %d.%d", &major, &minor) != 2)
+        return 0;
+    return major * 10 + minor;
+}
+
+void queryDeviceInfo(const cl_platform_id& platform, const cl_device_id& device, deviceInfo& info) {
+    info.platform = platform;
+    info.device = device;
+    info.platformName = getPlatformString(platform, CL_PLATFORM_NAME);
+    info.name = getDeviceString(device, CL_DEVICE_NAME);
+    info.driverVersion = getDeviceString(device, CL_DRIVER_VERSION);
+    info.version = getDeviceString(device, CL_DEVICE_VERSION);
+    info.extensions = getDeviceString(device, CL_DEVICE_EXTENSIONS);
+    info.type = getDeviceValue<cl_device_type>(device, CL_DEVICE_TYPE);
+    info.computeUnits = getDeviceValue<cl_uint>(device, CL_DEVICE_MAX_COMPUTE_UNITS);
+    info.maxWorkGroupSize = getDeviceValue<size_t>(device, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+    info.localMemSize = getDeviceValue<cl_ulong>(device, CL_DEVICE_LOCAL_MEM_SIZE);
+    info.globalMemSize = getDeviceValue<cl_ulong>(device, CL_DEVICE_GLOBAL_MEM_SIZE);
+    info.maxAllocSize = getDeviceValue<cl_ulong>(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+    info.vectorWidthHalf = getDeviceValue<cl_uint>(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF);
+    info.vectorWidthFloat = getDeviceValue<cl_uint>(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT);
+    info.vectorWidthDouble = getDeviceValue<cl_uint>(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE);
+    info.fp16 = info.extensions.find("cl_khr_fp16") != std::string::npos;
+    info.fp64 = info.extensions.find("cl_khr_fp64") != std::string::npos;
+    // CL_DEVICE_DOUBLE_FP_CONFIG is core since 1.2 only, older devices may reject the query
+    if (!info.fp64 && openCLVersion(info.version) >= 12) {
+        cl_device_fp_config config = 0;
+        info.fp64 = clGetDeviceInfo(device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(config), &config, NULL) == CL_SUCCESS && config != 0;
+    }
+    info.imageSupport = getDeviceValue<cl_bool>(device, CL_DEVICE_IMAGE_SUPPORT) == CL_TRUE;
+}
+
+void getDeviceInventory(std::vector<deviceInfo>& inventory) {
+    inventory.clear();
+    cl_uint numPlatforms = 0;
+    if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS)
+        throw std::runtime_error("Can't get number platforms");
+
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    if (clGetPlatformIDs(numPlatforms, platforms.data(), NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't get platforms");
+
+    for (cl_uint i = 0; i < numPlatforms; i++) {
+        cl_uint numDevices = 0;
+        cl_int retCode = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices);
+        if (retCode == CL_DEVICE_NOT_FOUND)
+            continue;
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't get number devices");
+
+        std::vector<cl_device_id> devices(numDevices);
+        if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, numDevices, devices.data(), NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't get devices");
+        for (cl_uint j = 0; j < numDevices; j++) {
+            deviceInfo info;
+            queryDeviceInfo(platforms[i], devices[j], info);
+            inventory.push_back(info);
+        }
+    }
+}
+
+// Picks the device of the requested type with the most compute units across all platforms
+void selectDevice(const cl_device_type& dt, deviceInfo& info) {
+    std::vector<deviceInfo> inventory;
+    getDeviceInventory(inventory);
+
+    const deviceInfo* best = nullptr;
+    for (size_t i = 0; i < inventory.size(); i++) {
+        if ((inventory[i].type & dt) == 0)
+            continue;
+        if (best == nullptr || inventory[i].computeUnits > best->computeUnits)
+            best = &inventory[i];
+    }
+    if (best == nullptr)
+        throw std::runtime_error(std::string("Can't find ") + (dt == CL_DEVICE_TYPE_GPU ? "GPU" : "CPU") + " device");
+    info = *best;
+}
+
+void printDeviceInfo(const deviceInfo& info) {
+    std::cout << "\t" << info.name << " (" << info.platformName << ", driver " << info.driverVersion << ")" << std::endl;
+    std::cout << "\t\tcompute units: " << info.computeUnits << ", max work group: " << info.maxWorkGroupSize
+        << ", local mem: " << info.localMemSize / 1024 << " KB, global mem: " << info.globalMemSize / (1024 * 1024) << " MB" << std::endl;
+    std::cout << "\t\tvector width half/float/double: " << info.vectorWidthHalf << "/" << info.vectorWidthFloat << "/" << info.vectorWidthDouble
+        << ", fp16: " << (info.fp16 ? "yes" : "no") << ", fp64: " << (info.fp64 ? "yes" : "no")
+        << ", images: " << (info.imageSupport ? "yes" : "no") << std::endl;
+}
+
+// Options every program is built with, kernels guard their double code with USE_FP64
+std::string deviceBuildOptions(const deviceInfo& info) {
+    return info.fp64 ? "-DUSE_FP64" : "";
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Dispatches independent kernels over several queues (optionally out-of-order ones) of one device,
+// so small launches that can't fill the device alone run side by side. Completion is tracked with events.
+
+enum dispatchPolicy {
+    ROUND_ROBIN,
+    LEAST_LOADED
+};
+
+struct executor {
+    cl_context context{};
+    cl_device_id device{};
+    std::vector<cl_command_queue> queues;
+    std::vector<std::vector<cl_event>> pending;
+    dispatchPolicy policy = dispatchPolicy::ROUND_ROBIN;
+    bool outOfOrder = false;
+    size_t next = 0;
+};
+
+// Out-of-order queues are used only when the device reports support for them
+void createExecutor(const cl_context& context, const cl_device_id& device, const size_t numQueues, const bool outOfOrder,
+                    const dispatchPolicy policy, executor& ex) {
+    if (numQueues == 0)
+        throw std::runtime_error("Executor needs at least one queue");
+    cl_command_queue_properties supported{};
+    if (clGetDeviceInfo(device, CL_DEVICE_QUEUE_ON_HOST_PROPERTIES, sizeof(supported), &supported, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't get device queue properties");
+
+    ex.context = context;
+    ex.device = device;
+    ex.policy = policy;
+    ex.outOfOrder = outOfOrder && (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+    ex.next = 0;
+    const cl_queue_properties props[]{ CL_QUEUE_PROPERTIES, static_cast<cl_queue_properties>(ex.outOfOrder ? CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE : 0), 0 };
+    ex.queues.resize(numQueues);
+    ex.pending.resize(numQueues);
+    for (size_t i = 0; i < numQueues; i++) {
+        cl_int retCode = 0;
+        ex.queues[i] = clCreateCommandQueueWithProperties(context, device, props, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create executor queue");
+    }
+}
+
+// Releases the events of completed commands on queue and returns how many are still in flight
+size_t dropCompleted(executor& ex, const size_t queue) {
+    std::vector<cl_event>& events = ex.pending[queue];
+    size_t kept = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        cl_int status = CL_COMPLETE;
+        if (clGetEventInfo(events[i], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't get event status");
+        if (status == CL_COMPLETE)
+            clReleaseEvent(events[i]);
+        else
+            events[kept++] = events[i];
+    }
+    events.resize(kept);
+    return kept;
+}
+
+size_t pickQueue(executor& ex) {
+    if (ex.policy == dispatchPolicy::ROUND_ROBIN) {
+        size_t queue = ex.next;
+        ex.next = (ex.next + 1) % ex.queues.size();
+        dropCompleted(ex, queue);
+        return queue;
+    }
+    size_t best = 0;
+    size_t bestLoad = dropCompleted(ex, 0);
+    for (size_t i = 1; i < ex.queues.size() && bestLoad != 0; i++) {
+        size_t load = dropCompleted(ex, i);
+        if (load < bestLoad) {
+            best = i;
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+// Kernel arguments are captured at enqueue, so one cl_kernel can be resubmitted with new arguments.
+// The returned event stays owned by the executor, which releases it once a later pick sees it complete;
+// retain it to pass it in waitList of dependent work submitted after that.
+cl_event submit(executor& ex, const cl_kernel& kernel, const cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize,
+                const std::vector<cl_event>& waitList = std::vector<cl_event>()) {
+    const size_t queue = pickQueue(ex);
+    cl_event event{};
+    cl_int retCode = clEnqueueNDRangeKernel(ex.queues[queue], kernel, workDim, NULL, globalWorkSize, localWorkSize,
+                                            static_cast<cl_uint>(waitList.size()), waitList.empty() ? NULL : waitList.data(), &event);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't submit kernel execution: " + std::to_string(retCode));
+    clFlush(ex.queues[queue]);
+    ex.pending[queue].push_back(event);
+    return event;
+}
+
+void waitAll(executor& ex) {
+    for (size_t i = 0; i < ex.queues.size(); i++) {
+        if (clFinish(ex.queues[i]) != CL_SUCCESS)
+            throw std::runtime_error("Can't finish executor queue");
+        for (size_t j = 0; j < ex.pending[i].size(); j++)
+            clReleaseEvent(ex.pending[i][j]);
+        ex.pending[i].clear();
+    }
+}
+
+void releaseExecutor(executor& ex) {
+    waitAll(ex);
+    for (size_t i = 0; i < ex.queues.size(); i++)
+        clReleaseCommandQueue(ex.queues[i]);
+    ex.queues.clear();
+    ex.pending.clear();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Host side of the fused GEMM epilogue in kernels.cl (simpleGemmEpilogue/optGemmEpilogue): the build options
+// that select it and a reference applying the same steps to an unfused GEMM result.
+
+enum activationType {
+    NONE,
+    RELU,
+    GELU
+};
+
+struct gemmEpilogue {
+    float alpha = 1.0f;
+    float beta = 0.0f;
+    bool useC = false;
+    bool bias = false;
+    activationType activation = activationType::NONE;
+    bool residual = false;
+    bool halfOutput = false;
+};
+
+std::string epilogueOptions(const gemmEpilogue& ep) {
+    std::string options;
+    if (ep.useC)
+        options += " -DEPI_BETA";
+    if (ep.bias)
+        options += " -DEPI_BIAS";
+    if (ep.activation == activationType::RELU)
+        options += " -DEPI_RELU";
+    else if (ep.activation == activationType::GELU)
+        options += " -DEPI_GELU";
+    if (ep.residual)
+        options += " -DEPI_RESIDUAL";
+    if (ep.halfOutput)
+        options += " -DEPI_HALF";
+    return options;
+}
+
+// IEEE 754 binary16 with round to nearest even, as vstore_half_rte
+uint16_t floatToHalf(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    const uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFFu)
+        return sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u);
+    const int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 31)
+        return sign | 0x7C00u;
+    if (halfExponent <= 0) {
+        if (halfExponent < -10)
+            return sign;
+        mantissa |= 0x800000u;
+        const uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            half++;
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half++;
+    return sign | static_cast<uint16_t>(half);
+}
+
+float halfToFloat(const uint16_t value) {
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1Fu;
+    const uint32_t mantissa = value & 0x3FFu;
+    uint32_t bits;
+    if (exponent == 0x1Fu) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else {
+        const float subnormal = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign != 0 ? -subnormal : subnormal;
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Applies the epilogue in place to out = A * B (row1 x col2); c and residual are row1 x col2, bias has col2 values
+void applyEpilogue(const gemmEpilogue& ep, std::vector<float>& out, const unsigned int row1, const unsigned int col2,
+                   const std::vector<float>& c, const std::vector<float>& bias, const std::vector<float>& residual) {
+    for (size_t idx = 0; idx < static_cast<size_t>(row1) * col2; idx++) {
+        float value = ep.alpha * out[idx];
+        if (ep.useC)
+            value += ep.beta * c[idx];
+        if (ep.bias)
+            value += bias[idx % col2];
+        if (ep.activation == activationType::RELU)
+            value = std::fmax(value, 0.0f);
+        else if (ep.activation == activationType::GELU)
+            value = 0.5f * value * (1.0f + std::tanh(0.7978845608f * (value + 0.044715f * value * value * value)));
+        if (ep.residual)
+            value += residual[idx];
+        out[idx] = ep.halfOutput ? halfToFloat(floatToHalf(value)) : value;
+    }
+}
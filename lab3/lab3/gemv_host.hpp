@@ -0,0 +1,50 @@
+#pragma once
+
+#include <omp.h>
+#include <algorithm>
+
+// Open MP counterparts of the gemv/gemvT kernels for row-major A (rows x cols)
+
+namespace host {
+
+// y = alpha * A * x + beta * y, a simd dot product per row
+void gemv(const unsigned int rows, const unsigned int cols, const float alpha, const float* A, const float* x,
+          const float beta, float* y) {
+#pragma omp parallel for num_threads(8) schedule(static)
+    for (long long r = 0; r < static_cast<long long>(rows); r++) {
+        const float* a = A + static_cast<size_t>(r) * cols;
+        float acc = 0.0f;
+#pragma omp simd reduction(+:acc)
+        for (unsigned int c = 0; c < cols; c++)
+            acc += a[c] * x[c];
+        y[r] = alpha * acc + beta * y[r];
+    }
+}
+
+// y = alpha * A^T * x + beta * y; every thread owns a block of columns and streams all rows over it,
+// so the row segments stay contiguous and no partial results are shared
+void gemvT(const unsigned int rows, const unsigned int cols, const float alpha, const float* A, const float* x,
+           const float beta, float* y) {
+    const unsigned int block = 256;
+#pragma omp parallel num_threads(8)
+    {
+        float acc[block];
+#pragma omp for schedule(static)
+        for (long long b = 0; b < static_cast<long long>((cols + block - 1) / block); b++) {
+            const unsigned int begin = static_cast<unsigned int>(b) * block;
+            const unsigned int end = std::min(begin + block, cols);
+            std::fill(acc, acc + block, 0.0f);
+            for (unsigned int r = 0; r < rows; r++) {
+                const float* a = A + static_cast<size_t>(r) * cols;
+                const float xr = x[r];
+#pragma omp simd
+                for (unsigned int c = begin; c < end; c++)
+                    acc[c - begin] += a[c] * xr;
+            }
+            for (unsigned int c = begin; c < end; c++)
+                y[c] = alpha * acc[c - begin] + beta * y[c];
+        }
+    }
+}
+
+}
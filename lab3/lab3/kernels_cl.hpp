@@ -0,0 +1,516 @@
+// Generated by tools/embed_cl.py from kernels.cl, do not edit
+#pragma once
+
+const char kernelsSource[] =
+R"CLSRC(// BLOCK_SIZE is chosen by the host from the device limits
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE 16
+#endif
+
+// Shapes baked in by the specialization cache (jit_cache.hpp), otherwise the runtime arguments.
+// SPEC_EXACT means the launch covers exactly row1 x col2 work-items, so the bounds checks go away.
+#ifdef SPEC_COL1
+#define COL1 SPEC_COL1
+#else
+#define COL1 col1
+#endif
+#ifdef SPEC_ROW1
+#define ROW1 SPEC_ROW1
+#else
+#define ROW1 row1
+#endif
+#ifdef SPEC_COL2
+#define COL2 SPEC_COL2
+#else
+#define COL2 col2
+#endif
+#ifdef SPEC_EXACT
+#define IN_BOUNDS(row, col) 1
+#else
+#define IN_BOUNDS(row, col) ((row) < ROW1 && (col) < COL2)
+#endif
+
+// Fused epilogue of the *GemmEpilogue kernels, applied in registers before the single store:
+// value = alpha * acc [+ beta * c (EPI_BETA)] [+ bias[col] (EPI_BIAS)], then EPI_RELU or EPI_GELU,
+// then [+ residual (EPI_RESIDUAL)]. With EPI_HALF out holds halfs written by vstore_half_rte.
+#ifdef EPI_HALF
+#define OUT_TYPE half
+#define STORE_OUT(out, idx, value) vstore_half_rte(value, idx, out)
+#else
+#define OUT_TYPE float
+#define STORE_OUT(out, idx, value) (out)[idx] = (value)
+#endif
+
+float epilogue(float acc, uint idx, uint col, float alpha, float beta,
+               __global const float *c, __global const float *bias, __global const float *residual) {
+    float value = alpha * acc;
+#ifdef EPI_BETA
+    value += beta * c[idx];
+#endif
+#ifdef EPI_BIAS
+    value += bias[col];
+#endif
+#if defined(EPI_RELU)
+    value = fmax(value, 0.0f);
+#elif defined(EPI_GELU)
+    value = 0.5f * value * (1.0f + tanh(0.7978845608f * (value + 0.044715f * value * value * value)));
+#endif
+#ifdef EPI_RESIDUAL
+    value += residual[idx];
+#endif
+    return value;
+}
+
+__kernel void slowSimpleGemm(__global float *in1, __global float *in2, __global float *out,
+                         unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    unsigned int row = get_global_id(0);
+    unsigned int col = get_global_id(1);
+
+    if (IN_BOUNDS(row, col)) {
+        float acc = 0.0f;
+        for (size_t i = 0; i < COL1; i++) {
+            acc += in1[row * COL1 + i] * in2[i * COL2 + col];
+        }
+        out[row * COL2 + col] = acc;
+    }
+}
+
+__kernel void simpleGemm(__global float *in1, __global float *in2, __global float *out,
+                         unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    unsigned int row = get_global_id(1);
+    unsigned int col = get_global_id(0);
+
+    if (IN_BOUNDS(row, col)) {
+        float acc = 0.0f;
+        for (size_t i = 0; i < COL1; i++) {
+            acc += in1[row * COL1 + i] * in2[i * COL2 + col];
+        }
+        out[row * COL2 + col] = acc;
+    }
+}
+
+__kernel void slowOptGemm(__global float *in1, __global float *in2, __global float *out,
+                      unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    const int row = get_local_id(0);
+    const int col = get_local_id(1);
+    const int globalRow = get_global_id(0);
+    const int globalCol = get_global_id(1);
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc = 0.0f;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledRow = BLOCK_SIZE*t + row;
+        const int tiledCol = BLOCK_SIZE*t + col;
+        Asub[row][col] = in1[globalRow * COL1 + tiledCol];
+        Bsub[row][col] = in2[tiledRow*COL2 + globalCol];
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            acc += Asub[row][k] * Bsub[k][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    out[globalRow * COL2 + globalCol] = acc;
+}
+
+__kernel void optGemm(__global float *in1, __global float *in2, __global float *out,
+                      unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_global_id(1);
+    const int globalCol = get_global_id(0);
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc = 0.0f;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledRow = BLOCK_SIZE*t + row;
+        const int tiledCol = BLOCK_SIZE*t + col;
+        Asub[row][col] = in1[globalRow * COL1 + tiledCol];
+        Bsub[row][col] = in2[tiledRow*COL2 + globalCol];
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            acc += Asub[row][k] * Bsub[k][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    out[globalRow * COL2 + globalCol] = acc;
+}
+
+__kernel void simpleGemmEpilogue(__global float *in1, __global float *in2, __global OUT_TYPE *out,
+                                 unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2,
+                                 float alpha, float beta, __global const float *c, __global const float *bias, __global const float *residual) {
+    unsigned int row = get_global_id(1);
+    unsigned int col = get_global_id(0);
+
+    if (IN_BOUNDS(row, col)) {
+        float acc = 0.0f;
+        for (size_t i = 0; i < COL1; i++) {
+            acc += in1[row * COL1 + i] * in2[i * COL2 + col];
+        }
+        const uint idx = row * COL2 + col;
+        STORE_OUT(out, idx, epilogue(acc, idx, col, alpha, beta, c, bias, residual));
+    }
+}
+
+__kernel void optGemmEpilogue(__global float *in1, __global float *in2, __global OUT_TYPE *out,
+                              unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2,
+                              float alpha, float beta, __global const float *c, __global const float *bias, __global const float *residual) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_global_id(1);
+    const int globalCol = get_global_id(0);
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc = 0.0f;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledRow = BLOCK_SIZE*t + row;
+        const int tiledCol = BLOCK_SIZE*t + col;
+        Asub[row][col] = in1[globalRow * COL1 + tiledCol];
+        Bsub[row][col] = in2[tiledRow*COL2 + globalCol];
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            acc += Asub[row][k] * Bsub[k][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const uint idx = globalRow * COL2 + globalCol;
+    STORE_OUT(out, idx, epilogue(acc, idx, globalCol, alpha, beta, c, bias, residual));
+}
+
+__kernel void imageGemm(__read_only image2d_t in1, __read_only image2d_t in2, __write_only image2d_t out,
+                        unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_global_id(1);
+    const int globalCol = get_global_id(0);
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc = 0.0f;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledRow = BLOCK_SIZE*t + row;
+        const int tiledCol = BLOCK_SIZE*t + col;
+        int2 coordIn1 = (int2)(tiledCol, globalRow); 
+        int2 coordIn2 = (int2)(globalCol, tiledRow);
+        Asub[row][col] = read_imagef(in1, coordIn1).x;
+        Bsub[row][col] = read_imagef(in2, coordIn2).x;
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            acc += Asub[row][k] * Bsub[k][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    int2 coordOut = (int2)(globalCol, globalRow);
+    write_imagef(out, coordOut, acc);
+}
+
+// Split-K for outputs too small to fill the device: the third dimension splits K, split z multiplies the range
+)CLSRC"
+R"CLSRC(// [z * kChunk, (z + 1) * kChunk) (kChunk a multiple of BLOCK_SIZE, the last range may be shorter) and stores its
+// tile to slice z of partial; splitKReduce then sums the slices in a fixed order, so results are deterministic.
+// Loads and stores are bounds checked, so rows, columns and K need not be multiples of BLOCK_SIZE.
+__kernel void splitKGemm(__global float *in1, __global float *in2, __global float *partial,
+                         unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2, unsigned int kChunk) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_global_id(1);
+    const int globalCol = get_global_id(0);
+    const uint split = get_global_id(2);
+    const uint kBegin = split * kChunk;
+    const uint kEnd = min(kBegin + kChunk, (uint)COL1);
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc = 0.0f;
+
+    for (uint k = kBegin; k < kEnd; k += BLOCK_SIZE) {
+        Asub[row][col] = globalRow < ROW1 && k + col < kEnd ? in1[globalRow * COL1 + k + col] : 0.0f;
+        Bsub[row][col] = k + row < kEnd && globalCol < COL2 ? in2[(k + row) * COL2 + globalCol] : 0.0f;
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            acc += Asub[row][i] * Bsub[i][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (IN_BOUNDS(globalRow, globalCol))
+        partial[(size_t)split * ROW1 * COL2 + globalRow * COL2 + globalCol] = acc;
+}
+
+__kernel void splitKReduce(__global const float *partial, __global float *out, const unsigned int n, const unsigned int splits) {
+    const uint i = get_global_id(0);
+    if (i < n) {
+        float acc = 0.0f;
+        for (uint s = 0; s < splits; s++)
+            acc += partial[(size_t)s * n + i];
+        out[i] = acc;
+    }
+}
+
+// Register blocking: a BLOCK_SIZE x BLOCK_SIZE output tile per work-group of BLOCK_SIZE x (BLOCK_SIZE / WPT)
+// work-items, each accumulating WPT outputs of one column in registers. Every value of Bsub read from local
+// memory is reused WPT times.
+#ifndef WPT
+#define WPT 4
+#endif
+#define RTS (BLOCK_SIZE / WPT)
+
+__kernel void blockedGemm(__global float *in1, __global float *in2, __global float *out,
+                          unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_group_id(1) * BLOCK_SIZE + row;
+    const int globalCol = get_group_id(0) * BLOCK_SIZE + col;
+
+    __local float Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local float Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    float acc[WPT];
+    for (int w = 0; w < WPT; w++)
+        acc[w] = 0.0f;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        for (int w = 0; w < WPT; w++) {
+            const int tiledRow = BLOCK_SIZE*t + row + w*RTS;
+            const int tiledCol = BLOCK_SIZE*t + col;
+            Asub[row + w*RTS][col] = in1[(globalRow + w*RTS) * COL1 + tiledCol];
+            Bsub[row + w*RTS][col] = in2[tiledRow*COL2 + globalCol];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            const float b = Bsub[k][col];
+            for (int w = 0; w < WPT; w++)
+                acc[w] += Asub[row + w*RTS][k] * b;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int w = 0; w < WPT; w++)
+        out[(globalRow + w*RTS) * COL2 + globalCol] = acc[w];
+}
+
+// Double precision versions of simpleGemm, optGemm and blockedGemm; the host picks BLOCK_SIZE for the
+// doubled local memory footprint
+#ifdef USE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+__kernel void simpleDgemm(__global double *in1, __global double *in2, __global double *out,
+                          unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    unsigned int row = get_global_id(1);
+    unsigned int col = get_global_id(0);
+
+    if (IN_BOUNDS(row, col)) {
+        double acc = 0.0;
+        for (size_t i = 0; i < COL1; i++) {
+            acc += in1[row * COL1 + i] * in2[i * COL2 + col];
+        }
+        out[row * COL2 + col] = acc;
+    }
+}
+
+__kernel void optDgemm(__global double *in1, __global double *in2, __global double *out,
+                       unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_global_id(1);
+    const int globalCol = get_global_id(0);
+
+    __local double Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local double Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    double acc = 0.0;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledRow = BLOCK_SIZE*t + row;
+        const int tiledCol = BLOCK_SIZE*t + col;
+        Asub[row][col] = in1[globalRow * COL1 + tiledCol];
+        Bsub[row][col] = in2[tiledRow*COL2 + globalCol];
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            acc += Asub[row][k] * Bsub[k][col];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    out[globalRow * COL2 + globalCol] = acc;
+}
+
+__kernel void blockedDgemm(__global double *in1, __global double *in2, __global double *out,
+                           unsigned int col1, unsigned int row1, unsigned int col2, unsigned int row2) {
+    const int row = get_local_id(1);
+    const int col = get_local_id(0);
+    const int globalRow = get_group_id(1) * BLOCK_SIZE + row;
+    const int globalCol = get_group_id(0) * BLOCK_SIZE + col;
+
+    __local double Asub[BLOCK_SIZE][BLOCK_SIZE];
+    __local double Bsub[BLOCK_SIZE][BLOCK_SIZE];
+
+    double acc[WPT];
+    for (int w = 0; w < WPT; w++)
+        acc[w] = 0.0;
+
+    const int numTiles = COL1 / BLOCK_SIZE;
+    for (int t = 0; t < numTiles; t++) {
+        for (int w = 0; w < WPT; w++) {
+            const int tiledRow = BLOCK_SIZE*t + row + w*RTS;
+            const int tiledCol = BLOCK_SIZE*t + col;
+            Asub[row + w*RTS][col] = in1[(globalRow + w*RTS) * COL1 + tiledCol];
+            Bsub[row + w*RTS][col] = in2[tiledRow*COL2 + globalCol];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            const double b = Bsub[k][col];
+            for (int w = 0; w < WPT; w++)
+                acc[w] += Asub[row + w*RTS][k] * b;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int w = 0; w < WPT; w++)
+        out[(globalRow + w*RTS) * COL2 + globalCol] = acc[w];
+}
+#endif
+
+// GEMV on row-major A (rows x cols). GEMV_WG and GEMVT_ROWS are powers of two chosen by the host.
+#ifndef GEMV_WG
+#define GEMV_WG 256
+#endif
+#ifndef GEMVT_ROWS
+#define GEMVT_ROWS 16
+#endif
+#define GEMVT_COLS 16
+
+// y = alpha * A * x + beta * y: one work-group per row, read with vload4 and reduced in local memory
+__kernel void gemv(__global const float *A, __global const float *x, __global float *y,
+                   const unsigned int rows, const unsigned int cols, const float alpha, const float beta) {
+    __local float partial[GEMV_WG];
+    const uint row = get_group_id(0);
+    const uint lid = get_local_id(0);
+    __global const float *a = A + (size_t)row * cols;
+
+    float acc = 0.0f;
+    const uint vecCols = cols / 4;
+    for (uint i = lid; i < vecCols; i += GEMV_WG)
+        acc += dot(vload4(i, a), vload4(i, x));
+    for (uint i = 4 * vecCols + lid; i < cols; i += GEMV_WG)
+        acc += a[i] * x[i];
+    partial[lid] = acc;
+
+    for (uint s = GEMV_WG / 2; s > 0; s >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < s)
+            partial[lid] += partial[lid + s];
+    }
+    if (lid == 0)
+        y[row] = alpha * partial[0] + beta * y[row];
+}
+
+// y = alpha * A^T * x + beta * y, y has cols elements. Work-item (i, j) of a GEMVT_COLS x GEMVT_ROWS group
+// sums 4 adjacent columns over rows j, j + GEMVT_ROWS, ..., so a row of the group is one contiguous run of
+)CLSRC"
+R"CLSRC(// vload4s; the GEMVT_ROWS partial sums are reduced in local memory.
+__kernel void gemvT(__global const float *A, __global const float *x, __global float *y,
+                    const unsigned int rows, const unsigned int cols, const float alpha, const float beta) {
+    __local float4 partial[GEMVT_ROWS][GEMVT_COLS];
+    const uint lc = get_local_id(0);
+    const uint lr = get_local_id(1);
+    const uint col = 4 * get_global_id(0);
+
+    float4 acc = (float4)(0.0f);
+    if (col + 4 <= cols) {
+        for (uint r = lr; r < rows; r += GEMVT_ROWS)
+            acc += vload4(0, A + (size_t)r * cols + col) * x[r];
+    } else if (col < cols) {
+        float tail[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (uint r = lr; r < rows; r += GEMVT_ROWS) {
+            for (uint c = col; c < cols; c++)
+                tail[c - col] += A[(size_t)r * cols + c] * x[r];
+        }
+        acc = vload4(0, tail);
+    }
+    partial[lr][lc] = acc;
+
+    for (uint s = GEMVT_ROWS / 2; s > 0; s >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lr < s)
+            partial[lr][lc] += partial[lr + s][lc];
+    }
+    if (lr == 0) {
+        float sum[4];
+        vstore4(partial[0][lc], 0, sum);
+        for (uint c = col; c < min(col + 4, cols); c++)
+            y[c] = alpha * sum[c - col] + beta * y[c];
+    }
+}
+
+// Philox4x32-10, mirrors rng::philox4x32 in random_utils.hpp (one work-item per counter block)
+uint4 philox4x32(uint4 ctr, uint2 key) {
+    for (int round = 0; round < 10; round++) {
+        uint hi0 = mul_hi(0xD2511F53u, ctr.x);
+        uint lo0 = 0xD2511F53u * ctr.x;
+        uint hi1 = mul_hi(0xCD9E8D57u, ctr.z);
+        uint lo1 = 0xCD9E8D57u * ctr.z;
+        ctr = (uint4)(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+        key += (uint2)(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return ctr;
+}
+
+__kernel void philoxMatrix(__global float* out, const unsigned int n, const uint seedLo, const uint seedHi, const int lo, const int hi) {
+    uint block = get_global_id(0);
+    uint4 r = philox4x32((uint4)(block, 0, 0, 0), (uint2)(seedLo, seedHi));
+    uint r4[4] = { r.x, r.y, r.z, r.w };
+    ulong range = (ulong)(hi - lo + 1);
+
+    for (uint lane = 0; lane < 4; lane++) {
+        uint idx = block * 4 + lane;
+        if (idx < n)
+            out[idx] = (float)(lo + (int)(((ulong)r4[lane] * range) >> 32));
+    }
+}
+)CLSRC";
@@ -1,28 +1,42 @@
 #include <iostream>
 #include <vector>
-#include <random>
+#include <algorithm>
+#include <climits>
+#include <limits>
 #include <omp.h>
 
 #include "opencl_utils.hpp"
+#include "npy_utils.hpp"
+#include "executor.hpp"
+#include "jit_cache.hpp"
+#include "gemm_epilogue.hpp"
+#include "conv_host.hpp"
+#include "perf_counters.hpp"
+#include "roofline.hpp"
+#include "results_store.hpp"
+#include "task_pool.hpp"
+#include "gemv_host.hpp"
 
-#define BLOCK_SIZE 16
-
-std::vector<float> getMatrix(const int& size) {
+std::vector<float> getMatrix(const int& size, const uint64_t& seed) {
     std::vector<float> resVector(size);
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dist(-100, 100);
-    //std::uniform_real_distribution<float> dist(-100, 100);
-
-    for (size_t i = 0; i < resVector.size(); i++)
-        resVector[i] = dist(gen);
+    rng::fillUniformInt(resVector.data(), 0, resVector.size(), seed, -100, 100);
 
     return resVector;
 }
 
+// Compulsory traffic (each matrix moved once) and work of a row1 x col1 by col1 x col2 product
+double gemmBytes(const unsigned int col1, const unsigned int row1, const unsigned int col2) {
+    return sizeof(float) * (static_cast<double>(row1) * col1 + static_cast<double>(col1) * col2 + static_cast<double>(row1) * col2);
+}
+
+double gemmFlops(const unsigned int col1, const unsigned int row1, const unsigned int col2) {
+    return 2.0 * row1 * col1 * col2;
+}
+
+// Naive serial product used to check the other paths, timed with perfRegion like the Open MP runs
 std::vector<float> reference(const std::vector<float>& A, const std::vector<float>& B,
                              const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2) {
-    if (A.size() != B.size()) {
+    if (A.size() != static_cast<size_t>(col1) * row1 || B.size() != static_cast<size_t>(col2) * row2 || col1 != row2) {
         throw std::runtime_error("Cant mult matrix");
     }
 
@@ -32,79 +46,233 @@ std::vector<float> reference(const std::vector<float>& A, const std::vector<floa
     const float* in2 = B.data();
     float* out = C.data();
     memset(out, 0, C.size() * sizeof(float));
-    double start = omp_get_wtime();
-    for (size_t id = 0; id < workAmount; id++) {
-        size_t col = id % col2;
-        size_t row = id / col2;
+    perfRegion("Reference", 1, gemmBytes(col1, row1, col2), gemmFlops(col1, row1, col2), [&]() {
+        for (size_t id = 0; id < workAmount; id++) {
+            size_t col = id % col2;
+            size_t row = id / col2;
 
-        const float* inA = in1 + col1 * row;
-        const float* inB = in2 + col;
+            const float* inA = in1 + col1 * row;
+            const float* inB = in2 + col;
 
-        for (unsigned int i = 0; i < col1; i++) {
-            out[id] += inA[i] * inB[i * col2];
+            for (unsigned int i = 0; i < col1; i++) {
+                out[id] += inA[i] * inB[i * col2];
+            }
         }
-    }
-    double end = omp_get_wtime();
-    std::cout << "Reference execution time: " << (end - start) << std::endl;
+    });
     return C;
 }
 
-void computeOMP(const std::vector<float>& _in1, const std::vector<float>& _in2, std::vector<float>& _out,
+void computeOMP(const float* _in1, const float* _in2, float* _out,
                 const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2) {
-    const unsigned int workAmount = row1 * col2;
-    _out.resize(workAmount);
+    const size_t workAmount = static_cast<size_t>(row1) * col2;
     double start = omp_get_wtime();
 #pragma omp parallel num_threads(8)
     {
-        unsigned int tid = static_cast<unsigned int>(omp_get_thread_num());
-        unsigned int nthreads = static_cast<unsigned int>(omp_get_num_threads());
-        unsigned int lwa = workAmount / nthreads;
-        unsigned int rem = 0;
-        if (tid == (nthreads - 1))
-            rem += workAmount % nthreads;
-        unsigned int start = tid * lwa;
-        unsigned int end = (tid + 1) * lwa + rem;
-        unsigned int startRow = start / col2;
-        unsigned int startCol = start % col2;
-        unsigned int endRow = end / col2;
-        unsigned int endCol = (end % col2) == 0 ? col2 : (end % col2);
-        for (unsigned int r = startRow; r < endRow; r++) {
-            for (unsigned int c = startCol; c < endCol; c++) {
-                float acc = 0.0f;
-                for (unsigned int i = 0; i < col1; i++) {
-                    acc += _in1[r * col1 + i] * _in2[i * col2 + c];
-                }
-                _out[r * col2 + c] = acc;
+        size_t tid = static_cast<size_t>(omp_get_thread_num());
+        size_t nthreads = static_cast<size_t>(omp_get_num_threads());
+        // contiguous range of output elements, may start and end in the middle of a row
+        size_t begin = workAmount * tid / nthreads;
+        size_t end = workAmount * (tid + 1) / nthreads;
+        for (size_t id = begin; id < end; id++) {
+            size_t r = id / col2;
+            size_t c = id % col2;
+            float acc = 0.0f;
+            for (unsigned int i = 0; i < col1; i++) {
+                acc += _in1[r * col1 + i] * _in2[static_cast<size_t>(i) * col2 + c];
             }
+            _out[id] = acc;
         }
     }
     double end = omp_get_wtime();
     std::cout << "Execution time: " << (end - start) << std::endl;
 }
 
+const size_t HOST_TILE = 64;
+
+// One 2D tile of out rows [rowBegin, rowEnd) and columns [colBegin, colEnd): rows of B are streamed along
+// the tile row so the inner loop is contiguous and vectorizes
+template <typename dataType>
+void hostGemmTile(const dataType* _in1, const dataType* _in2, dataType* _out, const unsigned int col1, const unsigned int col2,
+                  const size_t rowBegin, const size_t rowEnd, const size_t colBegin, const size_t colEnd) {
+    for (size_t r = rowBegin; r < rowEnd; r++) {
+        dataType* outRow = _out + r * col2;
+        for (size_t c = colBegin; c < colEnd; c++)
+            outRow[c] = dataType(0);
+        for (unsigned int i = 0; i < col1; i++) {
+            const dataType a = _in1[r * col1 + i];
+            const dataType* inRow = _in2 + static_cast<size_t>(i) * col2;
+#pragma omp simd
+            for (size_t c = colBegin; c < colEnd; c++)
+                outRow[c] += a * inRow[c];
+        }
+    }
+}
+
+// Same product as computeOMP with HOST_TILE x HOST_TILE output tiles as tasks of the work-stealing pool
+template <typename dataType>
+void computeTasks(const dataType* _in1, const dataType* _in2, dataType* _out,
+                  const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2) {
+    if (col1 != row2)
+        throw std::runtime_error("Cant mult matrix");
+    taskPool& pool = hostTaskPool();
+    double start = omp_get_wtime();
+    parallelTiles(pool, row1, col2, HOST_TILE, HOST_TILE, [&](size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd) {
+        hostGemmTile(_in1, _in2, _out, col1, col2, rowBegin, rowEnd, colBegin, colEnd);
+    });
+    double end = omp_get_wtime();
+    std::cout << "Execution time: " << (end - start) << std::endl;
+}
+
 enum bufferType {
     BUFFER,
     IMAGE
 };
 
-void computeOnDevice(const cl_platform_id& platform, const cl_device_type deviceType, const std::vector<char>& kernelText,
-                     const std::string kernelName, const std::vector<float>& _in1, const std::vector<float>& _in2, std::vector<float>& _out,
-                     const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2, bufferType bt = bufferType::BUFFER) {
-    cl_device_id device{};
-    getDevice(platform, deviceType, device);
+struct gemmLaunch {
+    std::string kernelName;
+    std::string options;
+    size_t tile{};
+    size_t globalWorkSize[2]{};
+    size_t localWorkSize[2]{};
+    // splitKGemm only: K ranges of kChunk, one per slice of the third dimension
+    size_t splits = 1;
+    size_t kChunk{};
+};
+
+const size_t SPLIT_K_MIN_CHUNK = 256;
+const size_t SPLIT_K_MAX_SPLITS = 64;
+
+// Tile size from the device work group and local memory limits (double kernels, *Dgemm, need twice the local
+// memory per tile, blocked* ones a work group of tile * tile / WPT); tiled kernels fall back to the bounds
+// checked ones when the shape isn't a multiple of the tile, imageGemm to optGemm without image support.
+// With allowSplitK an optGemm whose output tiles can't fill every compute unit twice becomes splitKGemm, whatever
+// the shape.
+gemmLaunch selectGemmLaunch(const deviceInfo& info, const std::string& kernelName, bufferType& bt,
+                            const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2,
+                            const bool allowSplitK = false) {
+    gemmLaunch launch;
+    launch.kernelName = kernelName;
+    const size_t elementSize = kernelName.find("Dgemm") != std::string::npos ? sizeof(double) : sizeof(float);
+    const bool blocked = kernelName.compare(0, 7, "blocked") == 0;
+    size_t wpt = blocked ? 4 : 1;
+    size_t tile = blocked ? 32 : 16;
+    while (tile > 1 && (tile * tile / std::min(wpt, tile) > info.maxWorkGroupSize || 2 * tile * tile * elementSize > info.localMemSize))
+        tile /= 2;
+    wpt = std::min(wpt, tile);
+    launch.tile = tile;
+
+    if (launch.kernelName == "imageGemm" && !info.imageSupport) {
+        launch.kernelName = "optGemm";
+        bt = bufferType::BUFFER;
+    }
+    if (allowSplitK && launch.kernelName == "optGemm" && bt == bufferType::BUFFER) {
+        // aim at 8 work-groups per compute unit, keeping every K range at least SPLIT_K_MIN_CHUNK long; decided
+        // before the ragged shape fallback, splitKGemm checks its bounds so any row1, col2 and K split
+        const size_t groups = static_cast<size_t>((row1 + tile - 1) / tile) * ((col2 + tile - 1) / tile);
+        const size_t computeUnits = info.computeUnits;
+        if (groups < 2 * computeUnits) {
+            size_t splits = (8 * computeUnits + groups - 1) / groups;
+            splits = std::min(splits, std::min<size_t>(SPLIT_K_MAX_SPLITS, col1 / std::max(SPLIT_K_MIN_CHUNK, tile)));
+            const size_t partialSize = sizeof(float) * row1 * col2;
+            while (splits > 1 && splits * partialSize > info.maxAllocSize)
+                splits--;
+            if (splits > 1) {
+                const size_t tilesK = (col1 + tile - 1) / tile;
+                launch.kChunk = (tilesK + splits - 1) / splits * tile;
+                launch.splits = (col1 + launch.kChunk - 1) / launch.kChunk;
+                launch.kernelName = "splitKGemm";
+            }
+        }
+    }
+    const bool tiled = launch.kernelName == "slowOptGemm" || launch.kernelName == "optGemm" || launch.kernelName == "imageGemm" ||
+                       launch.kernelName == "optGemmEpilogue" || launch.kernelName == "blockedGemm" ||
+                       launch.kernelName == "optDgemm" || launch.kernelName == "blockedDgemm";
+    if (tiled && (col1 % tile != 0 || row1 % tile != 0 || col2 % tile != 0)) {
+        if (launch.kernelName == "slowOptGemm")
+            launch.kernelName = "slowSimpleGemm";
+        else if (launch.kernelName == "optGemmEpilogue")
+            launch.kernelName = "simpleGemmEpilogue";
+        else if (elementSize == sizeof(double))
+            launch.kernelName = "simpleDgemm";
+        else
+            launch.kernelName = "simpleGemm";
+        bt = bufferType::BUFFER;
+        // a blocked tile may be too large for one work-item per output
+        while (tile > 1 && tile * tile > info.maxWorkGroupSize)
+            tile /= 2;
+        launch.tile = tile;
+    }
+    if (launch.kernelName != kernelName)
+        std::cout << "Use " << launch.kernelName << " instead of " << kernelName << std::endl;
+    launch.options = deviceBuildOptions(info) + " -DBLOCK_SIZE=" + std::to_string(tile);
+
+    // slow* kernels map dimension 0 to rows, the others to columns
+    const size_t rows = (row1 + tile - 1) / tile * tile;
+    const size_t cols = (col2 + tile - 1) / tile * tile;
+    const bool rowsFirst = launch.kernelName.compare(0, 4, "slow") == 0;
+    launch.globalWorkSize[0] = rowsFirst ? rows : cols;
+    launch.globalWorkSize[1] = rowsFirst ? cols : rows;
+    launch.localWorkSize[0] = tile;
+    launch.localWorkSize[1] = tile;
+    if (launch.kernelName.compare(0, 7, "blocked") == 0) {
+        // every work-item covers wpt rows
+        launch.options += " -DWPT=" + std::to_string(wpt);
+        launch.globalWorkSize[1] /= wpt;
+        launch.localWorkSize[1] /= wpt;
+    }
+    return launch;
+}
+
+void setGemmArguments(const cl_kernel& kernel, const cl_mem& in1, const cl_mem& in2, const cl_mem& out,
+                      const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2) {
+    if (clSetKernelArg(kernel, 0, sizeof(cl_mem), &in1) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 0 kernel arg");
+    if (clSetKernelArg(kernel, 1, sizeof(cl_mem), &in2) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 1 kernel arg");
+    if (clSetKernelArg(kernel, 2, sizeof(cl_mem), &out) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 2 kernel arg");
+    if (clSetKernelArg(kernel, 3, sizeof(unsigned int), &col1) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 3 kernel arg");
+    if (clSetKernelArg(kernel, 4, sizeof(unsigned int), &row1) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 4 kernel arg");
+    if (clSetKernelArg(kernel, 5, sizeof(unsigned int), &col2) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 5 kernel arg");
+    if (clSetKernelArg(kernel, 6, sizeof(unsigned int), &row2) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 6 kernel arg");
+}
+
+// With useHostPtr the buffers wrap _in1/_in2/_out directly (CL_MEM_USE_HOST_PTR), e.g. npy mappings.
+// Returns the kernel time in seconds.
+double computeOnDevice(const cl_device_type deviceType, const std::vector<char>& kernelText,
+                     const std::string kernelName, const float* _in1, const float* _in2, float* _out,
+                     const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2,
+                     bufferType bt = bufferType::BUFFER, const bool useHostPtr = false) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    const gemmLaunch launch = selectGemmLaunch(info, kernelName, bt, col1, row1, col2, row2, true);
+    if (useHostPtr && bt != bufferType::BUFFER)
+        throw std::runtime_error("Host ptr is supported only for buffers");
+    const size_t size1 = static_cast<size_t>(col1) * row1;
+    const size_t size2 = static_cast<size_t>(col2) * row2;
+    const size_t sizeOut = static_cast<size_t>(col2) * row1;
+
+    cl_device_id device = info.device;
     cl_context context{};
-    createContext(platform, device, context);
+    createContext(info.platform, device, context);
     cl_command_queue queue{};
     createQueue(context, device, queue);
     cl_program program{};
     cl_kernel kernel{};
-    createProgramAndKernel(context, device, program, kernel, kernelText, kernelName);
+    createProgramAndKernel(context, device, program, kernel, kernelText, launch.kernelName, launch.options);
 
     cl_int retCode;
 
     cl_mem in1{};
     if (bt == bufferType::BUFFER) {
-        in1 = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * _in1.size(), NULL, &retCode);
+        if (useHostPtr)
+            in1 = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(float) * size1, const_cast<float*>(_in1), &retCode);
+        else
+            in1 = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * size1, NULL, &retCode);
     } else if (bt == bufferType::IMAGE) {
         cl_image_format format{};
         format.image_channel_order = CL_R;
@@ -124,7 +292,10 @@ void computeOnDevice(const cl_platform_id& platform, const cl_device_type device
 
     cl_mem in2{};
     if (bt == bufferType::BUFFER) {
-        in2 = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * _in2.size(), NULL, &retCode);
+        if (useHostPtr)
+            in2 = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(float) * size2, const_cast<float*>(_in2), &retCode);
+        else
+            in2 = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * size2, NULL, &retCode);
     } else if (bt == bufferType::IMAGE) {
         cl_image_format format{};
         format.image_channel_order = CL_R;
@@ -144,7 +315,10 @@ void computeOnDevice(const cl_platform_id& platform, const cl_device_type device
 
     cl_mem out{};
     if (bt == bufferType::BUFFER) {
-        out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * row1 * col2, NULL, &retCode);
+        if (useHostPtr)
+            out = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, sizeof(float) * sizeOut, _out, &retCode);
+        else
+            out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * sizeOut, NULL, &retCode);
         if (retCode != CL_SUCCESS)
             throw std::runtime_error("Can't create out buffer");
     } else if (bt == bufferType::IMAGE) {
@@ -163,44 +337,64 @@ void computeOnDevice(const cl_platform_id& platform, const cl_device_type device
     }
 
     if (bt == bufferType::BUFFER) {
-        if (clEnqueueWriteBuffer(queue, in1, CL_TRUE, 0, sizeof(float) * _in1.size(), _in1.data(), 0, NULL, NULL) != CL_SUCCESS)
-            throw std::runtime_error("Can't write to in1 BUFFER");
-        if (clEnqueueWriteBuffer(queue, in2, CL_TRUE, 0, sizeof(float) * _in2.size(), _in2.data(), 0, NULL, NULL) != CL_SUCCESS)
-            throw std::runtime_error("Can't write to in2 BUFFER");
+        if (!useHostPtr) {
+            if (clEnqueueWriteBuffer(queue, in1, CL_TRUE, 0, sizeof(float) * size1, _in1, 0, NULL, NULL) != CL_SUCCESS)
+                throw std::runtime_error("Can't write to in1 BUFFER");
+            if (clEnqueueWriteBuffer(queue, in2, CL_TRUE, 0, sizeof(float) * size2, _in2, 0, NULL, NULL) != CL_SUCCESS)
+                throw std::runtime_error("Can't write to in2 BUFFER");
+        }
     } else if (bt == bufferType::IMAGE) {
         const size_t origin[3]{ 0, 0, 0 };
         const size_t region1[3]{col1, row1, 1};
-        retCode = clEnqueueWriteImage(queue, in1, CL_TRUE, origin, region1, 0, 0, _in1.data(), 0, nullptr, nullptr);
+        retCode = clEnqueueWriteImage(queue, in1, CL_TRUE, origin, region1, 0, 0, _in1, 0, nullptr, nullptr);
         if (retCode != CL_SUCCESS)
             throw std::runtime_error("Can't write to in1 IMAGE " + std::to_string(retCode));
 
         const size_t region2[3]{ col2, row2, 1 };
-        retCode = clEnqueueWriteImage(queue, in2, CL_TRUE, origin, region2, 0, 0, _in2.data(), 0, nullptr, nullptr);
+        retCode = clEnqueueWriteImage(queue, in2, CL_TRUE, origin, region2, 0, 0, _in2, 0, nullptr, nullptr);
         if (retCode != CL_SUCCESS)
             throw std::runtime_error("Can't write to in2 IMAGE " + std::to_string(retCode));
     } else {
         throw std::runtime_error("Unsupported buffer type for writing");
     }
 
-    if (clSetKernelArg(kernel, 0, sizeof(cl_mem), &in1) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 0 kernel arg");
-    if (clSetKernelArg(kernel, 1, sizeof(cl_mem), &in2) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 1 kernel arg");
-    if (clSetKernelArg(kernel, 2, sizeof(cl_mem), &out) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 2 kernel arg");
-    if (clSetKernelArg(kernel, 3, sizeof(unsigned int), &col1) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 3 kernel arg");
-    if (clSetKernelArg(kernel, 4, sizeof(unsigned int), &row1) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 4 kernel arg");
-    if (clSetKernelArg(kernel, 5, sizeof(unsigned int), &col2) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 5 kernel arg");
-    if (clSetKernelArg(kernel, 6, sizeof(unsigned int), &row2) != CL_SUCCESS)
-        throw std::runtime_error("Can't set 6 kernel arg");
+    // split-K: the kernel writes launch.splits partial products, splitKReduce sums them into out
+    cl_mem partial{};
+    cl_kernel reduce{};
+    if (launch.splits > 1) {
+        partial = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * sizeOut * launch.splits, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create partial buffer");
+        reduce = clCreateKernel(program, "splitKReduce", &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create splitKReduce kernel");
+        setGemmArguments(kernel, in1, in2, partial, col1, row1, col2, row2);
+        const unsigned int kChunk = static_cast<unsigned int>(launch.kChunk);
+        const unsigned int n = static_cast<unsigned int>(sizeOut);
+        const unsigned int splits = static_cast<unsigned int>(launch.splits);
+        if (clSetKernelArg(kernel, 7, sizeof(unsigned int), &kChunk) != CL_SUCCESS ||
+            clSetKernelArg(reduce, 0, sizeof(cl_mem), &partial) != CL_SUCCESS ||
+            clSetKernelArg(reduce, 1, sizeof(cl_mem), &out) != CL_SUCCESS ||
+            clSetKernelArg(reduce, 2, sizeof(unsigned int), &n) != CL_SUCCESS ||
+            clSetKernelArg(reduce, 3, sizeof(unsigned int), &splits) != CL_SUCCESS)
+            throw std::runtime_error("Can't set split-K kernel args");
+        std::cout << "Split K into " << launch.splits << " ranges of " << launch.kChunk << std::endl;
+    } else {
+        setGemmArguments(kernel, in1, in2, out, col1, row1, col2, row2);
+    }
 
-    size_t globalWorkSize[]{row1, col2};
-    size_t localWorkSize[]{ BLOCK_SIZE, BLOCK_SIZE };
     double start = omp_get_wtime();
-    retCode = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+    if (launch.splits > 1) {
+        const size_t globalWorkSize[3]{ launch.globalWorkSize[0], launch.globalWorkSize[1], launch.splits };
+        const size_t localWorkSize[3]{ launch.localWorkSize[0], launch.localWorkSize[1], 1 };
+        retCode = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+        if (retCode == CL_SUCCESS) {
+            const size_t reduceWorkSize = (sizeOut + 255) / 256 * 256;
+            retCode = clEnqueueNDRangeKernel(queue, reduce, 1, NULL, &reduceWorkSize, NULL, 0, NULL, NULL);
+        }
+    } else {
+        retCode = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL);
+    }
     if (retCode != CL_SUCCESS) {
         std::string err = "Can't run kernel execution: " + std::to_string(retCode);
         throw std::runtime_error(err);
@@ -210,19 +404,95 @@ void computeOnDevice(const cl_platform_id& platform, const cl_device_type device
     double end = omp_get_wtime();
     std::cout << "Execution time: " << (end - start) << std::endl;
 
-    _out.resize(row1 * col2);
-    if (bt == bufferType::BUFFER) {
-        if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, sizeof(float) * row1 * col2, _out.data(), 0, NULL, NULL) != CL_SUCCESS)
+    if (bt == bufferType::BUFFER && useHostPtr) {
+        // mapping makes the device copy (if the driver made one) visible through _out
+        void* mapped = clEnqueueMapBuffer(queue, out, CL_TRUE, CL_MAP_READ, 0, sizeof(float) * sizeOut, 0, NULL, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't map out buffer");
+        if (clEnqueueUnmapMemObject(queue, out, mapped, 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't unmap out buffer");
+        clFinish(queue);
+    } else if (bt == bufferType::BUFFER) {
+        if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, sizeof(float) * sizeOut, _out, 0, NULL, NULL) != CL_SUCCESS)
             throw std::runtime_error("Can't read from buffer");
     } else if (bt == bufferType::IMAGE) {
         const size_t origin[3]{ 0, 0, 0 };
         const size_t region1[3]{ col2, row1, 1 };
-        if (clEnqueueReadImage(queue, out, CL_TRUE, origin, region1, 0, 0, _out.data(), 0, NULL, NULL) != CL_SUCCESS)
+        if (clEnqueueReadImage(queue, out, CL_TRUE, origin, region1, 0, 0, _out, 0, NULL, NULL) != CL_SUCCESS)
             throw std::runtime_error("Can't read from image");
     } else {
         throw std::runtime_error("Unsupported buffer type for writing");
     }
 
+    if (launch.splits > 1) {
+        clReleaseMemObject(partial);
+        clReleaseKernel(reduce);
+    }
+    clReleaseMemObject(in1);
+    clReleaseMemObject(in2);
+    clReleaseMemObject(out);
+    clReleaseProgram(program);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    return end - start;
+}
+
+double computeOnDevice(const cl_device_type deviceType, const std::vector<char>& kernelText,
+                       const std::string kernelName, const std::vector<float>& _in1, const std::vector<float>& _in2, std::vector<float>& _out,
+                       const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2, bufferType bt = bufferType::BUFFER) {
+    _out.resize(row1 * col2);
+    return computeOnDevice(deviceType, kernelText, kernelName, _in1.data(), _in2.data(), _out.data(), col1, row1, col2, row2, bt);
+}
+
+// C = A * B in double precision with one of the *Dgemm kernels. Throws when the device has no fp64
+// (neither cl_khr_fp64 nor a CL_DEVICE_DOUBLE_FP_CONFIG). Returns the kernel time in seconds.
+double computeDgemmOnDevice(const cl_device_type deviceType, const std::vector<char>& kernelText, const std::string kernelName,
+                            const double* _in1, const double* _in2, double* _out,
+                            const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    if (!info.fp64)
+        throw std::runtime_error(info.name + " doesn't support fp64");
+    bufferType bt = bufferType::BUFFER;
+    const gemmLaunch launch = selectGemmLaunch(info, kernelName, bt, col1, row1, col2, row2);
+    const size_t size1 = static_cast<size_t>(col1) * row1;
+    const size_t size2 = static_cast<size_t>(col2) * row2;
+    const size_t sizeOut = static_cast<size_t>(col2) * row1;
+
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    cl_program program{};
+    cl_kernel kernel{};
+    createProgramAndKernel(context, device, program, kernel, kernelText, launch.kernelName, launch.options);
+
+    cl_int retCode;
+    cl_mem in1 = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(double) * size1, const_cast<double*>(_in1), &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create in1 buffer");
+    cl_mem in2 = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(double) * size2, const_cast<double*>(_in2), &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create in2 buffer");
+    cl_mem out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(double) * sizeOut, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create out buffer");
+    setGemmArguments(kernel, in1, in2, out, col1, row1, col2, row2);
+
+    double start = omp_get_wtime();
+    retCode = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't run kernel execution: " + std::to_string(retCode));
+    if (clFinish(queue) != CL_SUCCESS)
+        throw std::runtime_error("Can't finish kernel execution");
+    double end = omp_get_wtime();
+    std::cout << "Execution time: " << (end - start) << std::endl;
+
+    if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, sizeof(double) * sizeOut, _out, 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+
     clReleaseMemObject(in1);
     clReleaseMemObject(in2);
     clReleaseMemObject(out);
@@ -230,53 +500,1273 @@ void computeOnDevice(const cl_platform_id& platform, const cl_device_type device
     clReleaseKernel(kernel);
     clReleaseCommandQueue(queue);
     clReleaseContext(context);
+    return end - start;
+}
+
+// Every dgemm kernel against the host pool; without fp64 on the device the host result is all there is
+void computeDgemm(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int size, const uint64_t& seed) {
+    const std::vector<float> in1f = getMatrix(size * size, seed);
+    const std::vector<float> in2f = getMatrix(size * size, seed + 1);
+    const std::vector<double> in1(in1f.begin(), in1f.end());
+    const std::vector<double> in2(in2f.begin(), in2f.end());
+    std::vector<double> ref(static_cast<size_t>(size) * size);
+    std::vector<double> out(ref.size());
+
+    std::cout << "Tiled DGEMM work stealing" << std::endl;
+    computeTasks(in1.data(), in2.data(), ref.data(), size, size, size, size);
+
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    if (!info.fp64) {
+        std::cout << info.name << " doesn't support fp64, DGEMM stays on the host" << std::endl;
+        return;
+    }
+    const char* kernelNames[3]{ "simpleDgemm", "optDgemm", "blockedDgemm" };
+    for (size_t k = 0; k < 3; k++) {
+        std::cout << kernelNames[k] << " " << info.name << std::endl;
+        try {
+            computeDgemmOnDevice(deviceType, kernelText, kernelNames[k], in1.data(), in2.data(), out.data(), size, size, size, size);
+            compareRange(ref.data(), out.data(), out.size());
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+}
+
+void setEpilogueArguments(const cl_kernel& kernel, const gemmEpilogue& ep, const cl_mem& c, const cl_mem& bias, const cl_mem& residual) {
+    // buffers the epilogue doesn't read may be null
+    const cl_mem* buffers[3]{ &c, &bias, &residual };
+    if (clSetKernelArg(kernel, 7, sizeof(float), &ep.alpha) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 7 kernel arg");
+    if (clSetKernelArg(kernel, 8, sizeof(float), &ep.beta) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 8 kernel arg");
+    for (cl_uint i = 0; i < 3; i++) {
+        if (clSetKernelArg(kernel, 9 + i, sizeof(cl_mem), *buffers[i] != nullptr ? buffers[i] : NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't set " + std::to_string(9 + i) + " kernel arg");
+    }
+}
+
+cl_mem createInputBuffer(const cl_context& context, const cl_command_queue& queue, const std::vector<float>& data) {
+    if (data.empty())
+        return nullptr;
+    cl_int retCode;
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * data.size(), NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create input buffer");
+    if (clEnqueueWriteBuffer(queue, buffer, CL_TRUE, 0, sizeof(float) * data.size(), data.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't write to input buffer");
+    return buffer;
+}
+
+// out = epilogue(A * B) in one pass over C, half outputs are widened back to float on the host.
+// c, bias and residual are only read when ep enables them and may be empty otherwise.
+void computeEpilogueOnDevice(const cl_device_type deviceType, const std::vector<char>& kernelText, const gemmEpilogue& ep,
+                             const std::vector<float>& _in1, const std::vector<float>& _in2, const std::vector<float>& _c,
+                             const std::vector<float>& _bias, const std::vector<float>& _residual, std::vector<float>& _out,
+                             const unsigned int col1, const unsigned int row1, const unsigned int col2, const unsigned int row2) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    bufferType bt = bufferType::BUFFER;
+    gemmLaunch launch = selectGemmLaunch(info, "optGemmEpilogue", bt, col1, row1, col2, row2);
+    launch.options += epilogueOptions(ep);
+    const size_t sizeOut = static_cast<size_t>(col2) * row1;
+    const size_t outElement = ep.halfOutput ? sizeof(uint16_t) : sizeof(float);
+
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    cl_program program{};
+    cl_kernel kernel{};
+    createProgramAndKernel(context, device, program, kernel, kernelText, launch.kernelName, launch.options);
+
+    cl_mem in1 = createInputBuffer(context, queue, _in1);
+    cl_mem in2 = createInputBuffer(context, queue, _in2);
+    cl_mem c = ep.useC ? createInputBuffer(context, queue, _c) : nullptr;
+    cl_mem bias = ep.bias ? createInputBuffer(context, queue, _bias) : nullptr;
+    cl_mem residual = ep.residual ? createInputBuffer(context, queue, _residual) : nullptr;
+    cl_int retCode;
+    cl_mem out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, outElement * sizeOut, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create out buffer");
+
+    setGemmArguments(kernel, in1, in2, out, col1, row1, col2, row2);
+    setEpilogueArguments(kernel, ep, c, bias, residual);
+
+    double start = omp_get_wtime();
+    retCode = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't run kernel execution: " + std::to_string(retCode));
+    clFinish(queue);
+    double end = omp_get_wtime();
+    std::cout << launch.kernelName << " (" << epilogueOptions(ep) << " ) execution time: " << (end - start) << std::endl;
+
+    _out.resize(sizeOut);
+    if (ep.halfOutput) {
+        std::vector<uint16_t> halfs(sizeOut);
+        if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, outElement * sizeOut, halfs.data(), 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't read from buffer");
+        for (size_t i = 0; i < sizeOut; i++)
+            _out[i] = halfToFloat(halfs[i]);
+    } else if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, outElement * sizeOut, _out.data(), 0, NULL, NULL) != CL_SUCCESS) {
+        throw std::runtime_error("Can't read from buffer");
+    }
+
+    cl_mem buffers[6]{ in1, in2, c, bias, residual, out };
+    for (size_t i = 0; i < 6; i++) {
+        if (buffers[i] != nullptr)
+            clReleaseMemObject(buffers[i]);
+    }
+    clReleaseProgram(program);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+// Every epilogue variant against the plain GEMM followed by the same steps on the host
+void computeEpilogues(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int size, const uint64_t& seed) {
+    const std::vector<float> in1 = getMatrix(size * size, seed);
+    const std::vector<float> in2 = getMatrix(size * size, seed + 1);
+    const std::vector<float> c = getMatrix(size * size, seed + 2);
+    const std::vector<float> bias = getMatrix(size, seed + 3);
+    const std::vector<float> residual = getMatrix(size * size, seed + 4);
+    const std::vector<float> product = reference(in1, in2, size, size, size, size);
+
+    std::vector<gemmEpilogue> variants(5);
+    // scaled so the results stay well inside the half range
+    for (size_t i = 0; i < variants.size(); i++)
+        variants[i].alpha = 1.0f / (size * 64);
+    variants[1].useC = true;
+    variants[1].beta = 0.5f;
+    variants[2].bias = true;
+    variants[2].activation = activationType::RELU;
+    variants[3].bias = true;
+    variants[3].activation = activationType::GELU;
+    variants[3].residual = true;
+    variants[4] = variants[3];
+    variants[4].halfOutput = true;
+
+    for (size_t i = 0; i < variants.size(); i++) {
+        std::vector<float> out;
+        computeEpilogueOnDevice(deviceType, kernelText, variants[i], in1, in2, c, bias, residual, out, size, size, size, size);
+        std::vector<float> ref = product;
+        applyEpilogue(variants[i], ref, size, size, c, bias, residual);
+        compare(ref, out, 0.01f, variants[i].halfOutput ? 1.0f / 512 : 1e-5f);
+    }
+}
+
+cl_mem createOutputBuffer(const cl_context& context, const size_t size) {
+    cl_int retCode;
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * size, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create output buffer");
+    return buffer;
+}
+
+// Convolution through an explicit im2col buffer and the GEMM kernels. NHWC lowers the whole batch to one
+// (N*P*Q) x CRS matrix; NCHW goes image by image (K x CRS filter times CRS x P*Q columns), each result
+// copied to its place in the output.
+void computeConvIm2col(const cl_device_type deviceType, const convShape& cs, const std::vector<float>& _in,
+                       const std::vector<float>& _filter, std::vector<float>& _out) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    const bool nhwc = cs.layout == tensorLayout::NHWC;
+    const unsigned int pq = convOutHeight(cs) * convOutWidth(cs);
+    const unsigned int crs = cs.c * cs.r * cs.s;
+    const unsigned int colRows = nhwc ? cs.n * pq : crs;
+    const unsigned int colCols = nhwc ? crs : pq;
+    bufferType bt = bufferType::BUFFER;
+    const gemmLaunch launch = nhwc ? selectGemmLaunch(info, "optGemm", bt, crs, cs.n * pq, cs.k, crs)
+                                   : selectGemmLaunch(info, "optGemm", bt, crs, cs.k, pq, crs);
+
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    std::vector<char> gemmText, convText;
+    getKernelText(gemmText);
+    getConvKernelText(convText);
+    cl_program gemmProgram{}, convProgram{};
+    cl_kernel gemm{}, im2col{};
+    createProgramAndKernel(context, device, gemmProgram, gemm, gemmText, launch.kernelName, launch.options);
+    createProgramAndKernel(context, device, convProgram, im2col, convText, "im2col", deviceBuildOptions(info) + convOptions(cs));
+
+    cl_mem in = createInputBuffer(context, queue, _in);
+    cl_mem filter = createInputBuffer(context, queue, _filter);
+    cl_mem col = createOutputBuffer(context, static_cast<size_t>(colRows) * colCols);
+    cl_mem out = createOutputBuffer(context, convOutputSize(cs));
+    cl_mem imageOut = nhwc ? nullptr : createOutputBuffer(context, static_cast<size_t>(cs.k) * pq);
+    std::cout << "im2col buffer: " << sizeof(float) * colRows * colCols / 1024 << " KB for "
+        << sizeof(float) * _in.size() / 1024 << " KB of input" << std::endl;
+
+    const size_t colLocal[2]{ 16, 16 };
+    const size_t colGlobal[2]{ (colCols + 15) / 16 * 16, (colRows + 15) / 16 * 16 };
+    if (clSetKernelArg(im2col, 0, sizeof(cl_mem), &in) != CL_SUCCESS || clSetKernelArg(im2col, 1, sizeof(cl_mem), &col) != CL_SUCCESS)
+        throw std::runtime_error("Can't set im2col args");
+    if (nhwc)
+        setGemmArguments(gemm, col, filter, out, crs, cs.n * pq, cs.k, crs);
+    else
+        setGemmArguments(gemm, filter, col, imageOut, crs, cs.k, pq, crs);
+
+    double start = omp_get_wtime();
+    for (unsigned int image = 0; image < (nhwc ? 1 : cs.n); image++) {
+        const int imageArg = static_cast<int>(image);
+        if (clSetKernelArg(im2col, 2, sizeof(int), &imageArg) != CL_SUCCESS)
+            throw std::runtime_error("Can't set im2col args");
+        if (clEnqueueNDRangeKernel(queue, im2col, 2, NULL, colGlobal, colLocal[0] * colLocal[1] <= info.maxWorkGroupSize ? colLocal : NULL,
+                                   0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't run im2col execution");
+        if (clEnqueueNDRangeKernel(queue, gemm, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't run kernel execution");
+        if (!nhwc) {
+            const size_t bytes = sizeof(float) * cs.k * pq;
+            if (clEnqueueCopyBuffer(queue, imageOut, out, 0, bytes * image, bytes, 0, NULL, NULL) != CL_SUCCESS)
+                throw std::runtime_error("Can't copy image output");
+        }
+    }
+    clFinish(queue);
+    double end = omp_get_wtime();
+    std::cout << "im2col + " << launch.kernelName << " execution time: " << (end - start) << std::endl;
+
+    _out.resize(convOutputSize(cs));
+    if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, sizeof(float) * _out.size(), _out.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+
+    cl_mem buffers[5]{ in, filter, col, out, imageOut };
+    for (size_t i = 0; i < 5; i++) {
+        if (buffers[i] != nullptr)
+            clReleaseMemObject(buffers[i]);
+    }
+    clReleaseKernel(gemm);
+    clReleaseKernel(im2col);
+    clReleaseProgram(gemmProgram);
+    clReleaseProgram(convProgram);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+// Convolution as one tiled GEMM that gathers the im2col operand from the input on the fly
+void computeConvImplicit(const cl_device_type deviceType, const convShape& cs, const std::vector<float>& _in,
+                         const std::vector<float>& _filter, std::vector<float>& _out) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    const unsigned int npq = cs.n * convOutHeight(cs) * convOutWidth(cs);
+    const unsigned int crs = cs.c * cs.r * cs.s;
+    bufferType bt = bufferType::BUFFER;
+    const gemmLaunch launch = cs.layout == tensorLayout::NHWC ? selectGemmLaunch(info, "implicitGemmConv", bt, crs, npq, cs.k, crs)
+                                                              : selectGemmLaunch(info, "implicitGemmConv", bt, crs, cs.k, npq, crs);
+
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    std::vector<char> convText;
+    getConvKernelText(convText);
+    cl_program program{};
+    cl_kernel kernel{};
+    createProgramAndKernel(context, device, program, kernel, convText, launch.kernelName, launch.options + convOptions(cs));
+
+    cl_mem in = createInputBuffer(context, queue, _in);
+    cl_mem filter = createInputBuffer(context, queue, _filter);
+    cl_mem out = createOutputBuffer(context, convOutputSize(cs));
+    if (clSetKernelArg(kernel, 0, sizeof(cl_mem), &in) != CL_SUCCESS || clSetKernelArg(kernel, 1, sizeof(cl_mem), &filter) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &out) != CL_SUCCESS)
+        throw std::runtime_error("Can't set implicitGemmConv args");
+
+    double start = omp_get_wtime();
+    if (clEnqueueNDRangeKernel(queue, kernel, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't run kernel execution");
+    clFinish(queue);
+    double end = omp_get_wtime();
+    std::cout << launch.kernelName << " execution time: " << (end - start) << std::endl;
+
+    _out.resize(convOutputSize(cs));
+    if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, sizeof(float) * _out.size(), _out.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+
+    clReleaseMemObject(in);
+    clReleaseMemObject(filter);
+    clReleaseMemObject(out);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+void computeConvolutions(const cl_device_type deviceType, const uint64_t& seed) {
+    std::vector<convShape> shapes(3);
+    // 3x3 same padding, strided 5x5 and dilated 3x3, each in both layouts
+    shapes[0].n = 2; shapes[0].c = 32; shapes[0].h = 56; shapes[0].w = 56; shapes[0].k = 64; shapes[0].r = 3; shapes[0].s = 3;
+    shapes[0].padH = 1; shapes[0].padW = 1;
+    shapes[1].n = 1; shapes[1].c = 3; shapes[1].h = 224; shapes[1].w = 224; shapes[1].k = 32; shapes[1].r = 5; shapes[1].s = 5;
+    shapes[1].strideH = 2; shapes[1].strideW = 2; shapes[1].padH = 2; shapes[1].padW = 2;
+    shapes[2].n = 4; shapes[2].c = 16; shapes[2].h = 30; shapes[2].w = 30; shapes[2].k = 24; shapes[2].r = 3; shapes[2].s = 3;
+    shapes[2].dilationH = 2; shapes[2].dilationW = 2;
+
+    for (size_t i = 0; i < 2 * shapes.size(); i++) {
+        convShape cs = shapes[i / 2];
+        cs.layout = i % 2 == 0 ? tensorLayout::NCHW : tensorLayout::NHWC;
+        std::cout << (cs.layout == tensorLayout::NCHW ? "NCHW " : "NHWC ") << cs.n << "x" << cs.c << "x" << cs.h << "x" << cs.w
+            << " * " << cs.k << "x" << cs.r << "x" << cs.s << ", stride " << cs.strideH << ", pad " << cs.padH
+            << ", dilation " << cs.dilationH << std::endl;
+        std::vector<float> in(convInputSize(cs)), filter(convFilterSize(cs));
+        rng::fillUniformInt(in.data(), 0, in.size(), seed, -10, 10);
+        rng::fillUniformInt(filter.data(), 0, filter.size(), seed + 1, -10, 10);
+
+        std::vector<float> ref(convOutputSize(cs));
+        const double flops = 2.0 * convOutputSize(cs) * cs.c * cs.r * cs.s;
+        const double bytes = sizeof(float) * (convInputSize(cs) + convFilterSize(cs) + convOutputSize(cs));
+        perfRegion("Open MP", 8, bytes, flops, [&]() { host::conv2d(cs, in.data(), filter.data(), ref.data()); });
+
+        std::vector<float> out;
+        computeConvIm2col(deviceType, cs, in, filter, out);
+        compare(ref, out);
+        computeConvImplicit(deviceType, cs, in, filter, out);
+        compare(ref, out);
+    }
+}
+
+struct subDeviceJob {
+    deviceInfo info;
+    cl_context context{};
+    cl_command_queue queue{};
+    cl_program program{};
+    cl_kernel kernel{};
+    cl_kernel generator{};
+    cl_mem in1{}, in2{}, out{};
+    gemmLaunch launch;
+};
+
+// One GEMM job per CPU sub-device, each in its own context and queue, all running at the same time.
+// Matrices are generated by the sub-device itself into CL_MEM_ALLOC_HOST_PTR buffers, so their pages are
+// first touched by the threads the runtime pinned to that partition.
+void computeOnSubDevices(const std::vector<char>& kernelText, const std::string& partition, const unsigned int size, const uint64_t& seed) {
+    deviceInfo cpu;
+    selectDevice(CL_DEVICE_TYPE_CPU, cpu);
+    partitionType pt{};
+    std::vector<cl_uint> counts;
+    parsePartition(partition, pt, counts);
+    std::vector<cl_device_id> subDevices;
+    createSubDevices(cpu.device, pt, counts, subDevices);
+    std::cout << cpu.name << " partitioned into " << subDevices.size() << " sub devices" << std::endl;
+
+    const size_t elements = static_cast<size_t>(size) * size;
+    std::vector<subDeviceJob> jobs(subDevices.size());
+    for (size_t j = 0; j < jobs.size(); j++) {
+        subDeviceJob& job = jobs[j];
+        queryDeviceInfo(cpu.platform, subDevices[j], job.info);
+        createContext(cpu.platform, subDevices[j], job.context);
+        createQueue(job.context, subDevices[j], job.queue);
+        bufferType bt = bufferType::BUFFER;
+        job.launch = selectGemmLaunch(job.info, "optGemm", bt, size, size, size, size);
+        createProgramAndKernel(job.context, subDevices[j], job.program, job.kernel, kernelText, job.launch.kernelName, job.launch.options);
+        cl_int retCode;
+        job.generator = clCreateKernel(job.program, "philoxMatrix", &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create generator kernel");
+
+        const cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR;
+        job.in1 = clCreateBuffer(job.context, flags, sizeof(float) * elements, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create in1 buffer");
+        job.in2 = clCreateBuffer(job.context, flags, sizeof(float) * elements, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create in2 buffer");
+        job.out = clCreateBuffer(job.context, flags, sizeof(float) * elements, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create out buffer");
+        generateMatrixOnDevice(job.queue, job.generator, job.in1, static_cast<unsigned int>(elements), seed + 2 * j, -100, 100);
+        generateMatrixOnDevice(job.queue, job.generator, job.in2, static_cast<unsigned int>(elements), seed + 2 * j + 1, -100, 100);
+        setGemmArguments(job.kernel, job.in1, job.in2, job.out, size, size, size, size);
+    }
+    for (size_t j = 0; j < jobs.size(); j++)
+        clFinish(jobs[j].queue);
+
+    double start = omp_get_wtime();
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (clEnqueueNDRangeKernel(jobs[j].queue, jobs[j].kernel, 2, NULL, jobs[j].launch.globalWorkSize, jobs[j].launch.localWorkSize, 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't run kernel execution");
+        clFlush(jobs[j].queue);
+    }
+    for (size_t j = 0; j < jobs.size(); j++)
+        clFinish(jobs[j].queue);
+    double end = omp_get_wtime();
+    std::cout << jobs.size() << " concurrent " << size << "x" << size << " GEMM jobs execution time: " << (end - start) << std::endl;
+
+    std::vector<float> result(elements);
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (clEnqueueReadBuffer(jobs[j].queue, jobs[j].out, CL_TRUE, 0, sizeof(float) * elements, result.data(), 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't read from buffer");
+        std::vector<float> ref = reference(getMatrix(static_cast<int>(elements), seed + 2 * j), getMatrix(static_cast<int>(elements), seed + 2 * j + 1),
+                                           size, size, size, size);
+        compare(ref, result);
+    }
+
+    for (size_t j = 0; j < jobs.size(); j++) {
+        clReleaseMemObject(jobs[j].in1);
+        clReleaseMemObject(jobs[j].in2);
+        clReleaseMemObject(jobs[j].out);
+        clReleaseKernel(jobs[j].kernel);
+        clReleaseKernel(jobs[j].generator);
+        clReleaseProgram(jobs[j].program);
+        clReleaseCommandQueue(jobs[j].queue);
+        clReleaseContext(jobs[j].context);
+    }
+    releaseSubDevices(subDevices);
+}
+
+// count independent size x size GEMMs (inputs generated on the device) spread over numQueues queues
+void computeManySmall(const cl_device_type deviceType, const std::vector<char>& kernelText, const size_t count, const unsigned int size,
+                      const size_t numQueues, const bool outOfOrder, const uint64_t& seed) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    cl_context context{};
+    createContext(info.platform, info.device, context);
+    bufferType bt = bufferType::BUFFER;
+    const gemmLaunch launch = selectGemmLaunch(info, "optGemm", bt, size, size, size, size);
+    cl_program program{};
+    cl_kernel kernel{};
+    createProgramAndKernel(context, info.device, program, kernel, kernelText, launch.kernelName, launch.options);
+    cl_int retCode;
+    cl_kernel generator = clCreateKernel(program, "philoxMatrix", &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create generator kernel");
+
+    const size_t elements = static_cast<size_t>(size) * size;
+    std::vector<cl_mem> buffers(3 * count);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * elements, NULL, &retCode);
+        if (retCode != CL_SUCCESS)
+            throw std::runtime_error("Can't create buffer");
+    }
+
+    executor ex;
+    createExecutor(context, info.device, numQueues, outOfOrder, dispatchPolicy::LEAST_LOADED, ex);
+    const size_t generatorWorkSize = (elements + 3) / 4;
+    for (size_t i = 0; i < 2 * count; i++) {
+        setMatrixGeneratorArguments(generator, buffers[i], static_cast<unsigned int>(elements), seed + i, -100, 100);
+        submit(ex, generator, 1, &generatorWorkSize, NULL);
+    }
+    waitAll(ex);
+
+    double start = omp_get_wtime();
+    for (size_t i = 0; i < count; i++) {
+        setGemmArguments(kernel, buffers[2 * i], buffers[2 * i + 1], buffers[2 * count + i], size, size, size, size);
+        submit(ex, kernel, 2, launch.globalWorkSize, launch.localWorkSize);
+    }
+    waitAll(ex);
+    double end = omp_get_wtime();
+    std::cout << count << " GEMMs " << size << "x" << size << " on " << numQueues << (ex.outOfOrder ? " out-of-order" : " in-order")
+        << " queues execution time: " << (end - start) << std::endl;
+
+    std::vector<float> result(elements);
+    for (size_t i = 0; i < count; i++) {
+        if (clEnqueueReadBuffer(ex.queues[0], buffers[2 * count + i], CL_TRUE, 0, sizeof(float) * elements, result.data(), 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't read from buffer");
+        std::vector<float> ref = reference(getMatrix(static_cast<int>(elements), seed + 2 * i), getMatrix(static_cast<int>(elements), seed + 2 * i + 1),
+                                           size, size, size, size);
+        compare(ref, result);
+    }
+
+    releaseExecutor(ex);
+    for (size_t i = 0; i < buffers.size(); i++)
+        clReleaseMemObject(buffers[i]);
+    clReleaseKernel(generator);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+}
+
+// Repeats GEMM over a few shapes {col1, row1, col2} in one context; from the second use on,
+// a shape runs a kernel built with it baked in
+void computeRepeated(const cl_device_type deviceType, const std::vector<char>& kernelText,
+                     const std::vector<std::vector<unsigned int>>& shapes, const size_t repeats, const uint64_t& seed1, const uint64_t& seed2) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    cl_context context{};
+    createContext(info.platform, info.device, context);
+    cl_command_queue queue{};
+    createQueue(context, info.device, queue);
+
+    size_t maxIn1 = 0, maxIn2 = 0, maxOut = 0;
+    for (size_t s = 0; s < shapes.size(); s++) {
+        maxIn1 = std::max(maxIn1, static_cast<size_t>(shapes[s][0]) * shapes[s][1]);
+        maxIn2 = std::max(maxIn2, static_cast<size_t>(shapes[s][2]) * shapes[s][0]);
+        maxOut = std::max(maxOut, static_cast<size_t>(shapes[s][2]) * shapes[s][1]);
+    }
+    cl_int retCode;
+    cl_mem in1 = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * maxIn1, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create in1 buffer");
+    cl_mem in2 = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * maxIn2, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create in2 buffer");
+    cl_mem out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * maxOut, NULL, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create out buffer");
+
+    // one generic program per option set, its kernels are the fallback of the cache
+    std::map<std::string, cl_program> programs;
+    std::map<std::string, cl_kernel> generics;
+    specializationCache cache;
+    for (size_t r = 0; r <= repeats; r++) {
+        double start = omp_get_wtime();
+        for (size_t s = 0; s < shapes.size(); s++) {
+            const unsigned int col1 = shapes[s][0], row1 = shapes[s][1], col2 = shapes[s][2], row2 = col1;
+            bufferType bt = bufferType::BUFFER;
+            const gemmLaunch launch = selectGemmLaunch(info, "optGemm", bt, col1, row1, col2, row2);
+            if (programs.count(launch.options) == 0) {
+                cl_kernel generator{};
+                createProgramAndKernel(context, info.device, programs[launch.options], generator, kernelText, "philoxMatrix", launch.options);
+                if (r == 0 && s == 0) {
+                    generateMatrixOnDevice(queue, generator, in1, static_cast<unsigned int>(maxIn1), seed1, -100, 100);
+                    generateMatrixOnDevice(queue, generator, in2, static_cast<unsigned int>(maxIn2), seed2, -100, 100);
+                    clFinish(queue);
+                }
+                clReleaseKernel(generator);
+            }
+            const std::string genericName = launch.options + "/" + launch.kernelName;
+            if (generics.count(genericName) == 0) {
+                generics[genericName] = clCreateKernel(programs[launch.options], launch.kernelName.c_str(), &retCode);
+                if (retCode != CL_SUCCESS)
+                    throw std::runtime_error("Can't create kernel");
+            }
+
+            specializationDefines defines{ { "SPEC_COL1", col1 }, { "SPEC_ROW1", row1 }, { "SPEC_COL2", col2 } };
+            if (row1 % launch.tile == 0 && col2 % launch.tile == 0)
+                defines.push_back({ "SPEC_EXACT", 1 });
+            cl_kernel kernel = getSpecializedKernel(cache, context, info.device, kernelText, launch.kernelName, launch.options, defines, generics[genericName]);
+            setGemmArguments(kernel, in1, in2, out, col1, row1, col2, row2);
+            if (clEnqueueNDRangeKernel(queue, kernel, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL) != CL_SUCCESS)
+                throw std::runtime_error("Can't run kernel execution");
+
+            // the last pass checks every shape against the host
+            if (r == repeats) {
+                std::vector<float> result(static_cast<size_t>(row1) * col2);
+                if (clEnqueueReadBuffer(queue, out, CL_TRUE, 0, sizeof(float) * result.size(), result.data(), 0, NULL, NULL) != CL_SUCCESS)
+                    throw std::runtime_error("Can't read from buffer");
+                std::vector<float> ref = reference(getMatrix(col1 * row1, seed1), getMatrix(col2 * row2, seed2), col1, row1, col2, row2);
+                compare(ref, result);
+            }
+        }
+        clFinish(queue);
+        double end = omp_get_wtime();
+        if (r == 0 || r + 1 == repeats)
+            std::cout << "Pass " << r << " of " << shapes.size() << " shapes execution time: " << (end - start) << std::endl;
+    }
+    std::cout << "Specialized builds: " << cache.builds << ", hits: " << cache.hits << std::endl;
+
+    releaseSpecializationCache(cache);
+    for (std::map<std::string, cl_kernel>::iterator it = generics.begin(); it != generics.end(); ++it)
+        clReleaseKernel(it->second);
+    for (std::map<std::string, cl_program>::iterator it = programs.begin(); it != programs.end(); ++it)
+        clReleaseProgram(it->second);
+    clReleaseMemObject(in1);
+    clReleaseMemObject(in2);
+    clReleaseMemObject(out);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+// Checks res (row1 x col2) against the product recomputed bandRows rows at a time, so only one band of the
+// reference is resident. The band is a plain dot product per element like reference(), independent of the
+// tiled host path it checks.
+void verifyGemmChunked(const float* _in1, const float* _in2, const float* res,
+                       const unsigned int col1, const unsigned int row1, const unsigned int col2, const size_t bandRows) {
+    std::vector<float> band(bandRows * col2);
+    size_t bands = 0;
+    for (size_t rowBegin = 0; rowBegin < row1; rowBegin += bandRows, bands++) {
+        const size_t rows = std::min<size_t>(bandRows, row1 - rowBegin);
+        const float* in1 = _in1 + rowBegin * col1;
+#pragma omp parallel for num_threads(8) schedule(static)
+        for (long long r = 0; r < static_cast<long long>(rows); r++) {
+            for (size_t c = 0; c < col2; c++) {
+                float acc = 0.0f;
+                for (unsigned int i = 0; i < col1; i++)
+                    acc += in1[r * col1 + i] * _in2[static_cast<size_t>(i) * col2 + c];
+                band[r * col2 + c] = acc;
+            }
+        }
+        if (!compareRange(band.data(), res + rowBegin * col2, rows * col2, rowBegin * col2))
+            return;
+    }
+    std::cout << "Verified in " << bands << " bands of " << bandRows << " rows" << std::endl;
+}
+
+// Low footprint benchmark: A, B and one C are the only full matrices, the device wraps them (CL_MEM_USE_HOST_PTR)
+// and every backend writes the same C, verified band by band
+void computeLowMemory(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int size,
+                      const size_t bandRows, const uint64_t& seed) {
+    const std::vector<float> in1 = getMatrix(size * size, seed);
+    const std::vector<float> in2 = getMatrix(size * size, seed + 1);
+    std::vector<float> out(static_cast<size_t>(size) * size);
+
+    // C is poisoned before every backend, so a run that leaves elements unwritten can't pass on the previous result
+    const float poison = std::numeric_limits<float>::quiet_NaN();
+    std::cout << "Opt GEMM " << (deviceType == CL_DEVICE_TYPE_GPU ? "GPU" : "CPU") << std::endl;
+    try {
+        std::fill(out.begin(), out.end(), poison);
+        computeOnDevice(deviceType, kernelText, "optGemm", in1.data(), in2.data(), out.data(), size, size, size, size, bufferType::BUFFER, true);
+        verifyGemmChunked(in1.data(), in2.data(), out.data(), size, size, size, bandRows);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+    }
+    std::cout << "Simple GEMM Open MP" << std::endl;
+    std::fill(out.begin(), out.end(), poison);
+    computeOMP(in1.data(), in2.data(), out.data(), size, size, size, size);
+    verifyGemmChunked(in1.data(), in2.data(), out.data(), size, size, size, bandRows);
+    std::cout << "Tiled GEMM work stealing" << std::endl;
+    std::fill(out.begin(), out.end(), poison);
+    computeTasks(in1.data(), in2.data(), out.data(), size, size, size, size);
+    verifyGemmChunked(in1.data(), in2.data(), out.data(), size, size, size, bandRows);
+    printPeakRss();
+}
+
+// The first deviceShare of the rows of C go to the device, the rest to the host pool. Host tiles are queued
+// before the device launch, so the pool works while this thread waits on the device, then joins the pool.
+void computeHybrid(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int size,
+                   const double deviceShare, const uint64_t& seed) {
+    const std::vector<float> in1 = getMatrix(size * size, seed);
+    const std::vector<float> in2 = getMatrix(size * size, seed + 1);
+    std::vector<float> out(static_cast<size_t>(size) * size);
+    // multiple of the tile so the device keeps the tiled kernel
+    unsigned int deviceRows = static_cast<unsigned int>(deviceShare * size) / 16 * 16;
+    deviceRows = std::min(deviceRows, size);
+
+    taskPool& pool = hostTaskPool();
+    const size_t steals = pool.steals;
+    taskGroup group;
+    double hostEnd = 0.0;
+    std::mutex hostEndMutex;
+    double start = omp_get_wtime();
+    for (size_t r = deviceRows; r < size; r += HOST_TILE) {
+        for (size_t c = 0; c < size; c += HOST_TILE) {
+            const size_t rowEnd = std::min<size_t>(r + HOST_TILE, size);
+            const size_t colEnd = std::min<size_t>(c + HOST_TILE, size);
+            submitTask(pool, group, [&, r, rowEnd, c, colEnd]() {
+                hostGemmTile(in1.data(), in2.data(), out.data(), size, size, r, rowEnd, c, colEnd);
+                std::lock_guard<std::mutex> lock(hostEndMutex);
+                hostEnd = std::max(hostEnd, omp_get_wtime());
+            });
+        }
+    }
+    double deviceEnd = start;
+    if (deviceRows > 0) {
+        std::cout << "Device rows [0, " << deviceRows << ")" << std::endl;
+        try {
+            computeOnDevice(deviceType, kernelText, "optGemm", in1.data(), in2.data(), out.data(), size, deviceRows, size, size);
+        } catch (...) {
+            // queued tiles reference this frame
+            waitTaskGroup(pool, group);
+            throw;
+        }
+        deviceEnd = omp_get_wtime();
+    }
+    waitTaskGroup(pool, group);
+    double end = omp_get_wtime();
+    std::cout << "Device part done after: " << (deviceEnd - start) << ", host part after: " << (hostEnd > 0.0 ? hostEnd - start : 0.0)
+        << ", steals: " << pool.steals - steals << std::endl;
+    std::cout << "Hybrid execution time: " << (end - start) << std::endl;
+
+    std::vector<float> ref(out.size());
+    computeTasks(in1.data(), in2.data(), ref.data(), size, size, size, size);
+    compare(ref, out);
+}
+
+// A read once plus x and y: GEMV is bandwidth bound at any size
+double gemvBytes(const unsigned int rows, const unsigned int cols, const bool transposed) {
+    const double xSize = transposed ? rows : cols;
+    const double ySize = transposed ? cols : rows;
+    return sizeof(float) * (static_cast<double>(rows) * cols + xSize + 2.0 * ySize);
+}
+
+// gemv: one work-group per row, narrowed for short rows so most items still get a vload4;
+// gemvT: GEMVT_COLS x GEMVT_ROWS groups, each covering 4 * GEMVT_COLS columns
+gemmLaunch selectGemvLaunch(const deviceInfo& info, const bool transposed, const unsigned int rows, const unsigned int cols) {
+    gemmLaunch launch;
+    launch.options = deviceBuildOptions(info);
+    if (!transposed) {
+        size_t wg = 256;
+        while (wg > 16 && (wg > info.maxWorkGroupSize || 4 * wg > cols))
+            wg /= 2;
+        launch.kernelName = "gemv";
+        launch.options += " -DGEMV_WG=" + std::to_string(wg);
+        launch.globalWorkSize[0] = static_cast<size_t>(rows) * wg;
+        launch.globalWorkSize[1] = 1;
+        launch.localWorkSize[0] = wg;
+        launch.localWorkSize[1] = 1;
+    } else {
+        const size_t groupCols = 16;
+        size_t groupRows = 16;
+        while (groupRows > 1 && groupCols * groupRows > info.maxWorkGroupSize)
+            groupRows /= 2;
+        const size_t items = (cols + 3) / 4;
+        launch.kernelName = "gemvT";
+        launch.options += " -DGEMVT_ROWS=" + std::to_string(groupRows);
+        launch.globalWorkSize[0] = (items + groupCols - 1) / groupCols * groupCols;
+        launch.globalWorkSize[1] = groupRows;
+        launch.localWorkSize[0] = groupCols;
+        launch.localWorkSize[1] = groupRows;
+    }
+    return launch;
+}
+
+// Runs the GEMV iterations times on y (as a solver would) and reads the final y back into result.
+// Returns the mean time of one call in seconds.
+double computeGemvOnDevice(const cl_device_type deviceType, const std::vector<char>& kernelText, const bool transposed,
+                           const std::vector<float>& A, const std::vector<float>& x, const std::vector<float>& y,
+                           const unsigned int rows, const unsigned int cols, const float alpha, const float beta,
+                           const size_t iterations, std::vector<float>& result) {
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    const gemmLaunch launch = selectGemvLaunch(info, transposed, rows, cols);
+    cl_device_id device = info.device;
+    cl_context context{};
+    createContext(info.platform, device, context);
+    cl_command_queue queue{};
+    createQueue(context, device, queue);
+    cl_program program{};
+    cl_kernel kernel{};
+    createProgramAndKernel(context, device, program, kernel, kernelText, launch.kernelName, launch.options);
+
+    cl_mem aBuf = createInputBuffer(context, queue, A);
+    cl_mem xBuf = createInputBuffer(context, queue, x);
+    cl_int retCode;
+    cl_mem yBuf = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(float) * y.size(), const_cast<float*>(y.data()), &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create y buffer");
+    if (clSetKernelArg(kernel, 0, sizeof(cl_mem), &aBuf) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &xBuf) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &yBuf) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 3, sizeof(unsigned int), &rows) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 4, sizeof(unsigned int), &cols) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 5, sizeof(float), &alpha) != CL_SUCCESS ||
+        clSetKernelArg(kernel, 6, sizeof(float), &beta) != CL_SUCCESS)
+        throw std::runtime_error("Can't set gemv kernel args");
+    clFinish(queue);
+
+    double start = omp_get_wtime();
+    for (size_t i = 0; i < iterations; i++) {
+        if (clEnqueueNDRangeKernel(queue, kernel, 2, NULL, launch.globalWorkSize, launch.localWorkSize, 0, NULL, NULL) != CL_SUCCESS)
+            throw std::runtime_error("Can't run kernel execution");
+    }
+    if (clFinish(queue) != CL_SUCCESS)
+        throw std::runtime_error("Can't finish kernel execution");
+    double end = omp_get_wtime();
+    const double seconds = (end - start) / iterations;
+    std::cout << info.name << ": " << launch.kernelName << " (" << launch.options << ") " << seconds * 1e6 << " us, "
+        << gemvBytes(rows, cols, transposed) / seconds * 1e-9 << " GB/s" << std::endl;
+
+    result.resize(y.size());
+    if (clEnqueueReadBuffer(queue, yBuf, CL_TRUE, 0, sizeof(float) * result.size(), result.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+    clReleaseMemObject(aBuf);
+    clReleaseMemObject(xBuf);
+    clReleaseMemObject(yBuf);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    return seconds;
+}
+
+// Sums of products of integers in [-8, 8] stay exact in float (|sum| <= 64 * n < 2^24) up to this many terms,
+// in any order
+const unsigned int EXACT_SUM_TERMS = 1 << 18;
+
+// A * x and A^T * x on the host and on the device, iterations calls each, compared after the same number of calls.
+// Entries in [-8, 8] keep the dot products exact up to EXACT_SUM_TERMS, but the y update rounds, so the results
+// are compared with a relative tolerance. Longer dot products round in a summation order dependent way and get
+// a wider one. beta = 0.5 keeps y bounded over the iterations.
+void computeGemv(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int rows, const unsigned int cols,
+                 const size_t iterations, const uint64_t& seed) {
+    std::vector<float> A(static_cast<size_t>(rows) * cols);
+    rng::fillUniformInt(A.data(), 0, A.size(), seed, -8, 8);
+    const float alpha = 1.5f;
+    const float beta = 0.5f;
+    for (int t = 0; t < 2; t++) {
+        const bool transposed = t == 1;
+        const unsigned int xSize = transposed ? rows : cols;
+        const unsigned int ySize = transposed ? cols : rows;
+        std::vector<float> x(xSize), y(ySize);
+        rng::fillUniformInt(x.data(), 0, x.size(), seed + 1, -8, 8);
+        rng::fillUniformInt(y.data(), 0, y.size(), seed + 2, -8, 8);
+        std::cout << (transposed ? "A^T * x" : "A * x") << " (" << rows << " x " << cols << ")" << std::endl;
+        const bool exactSums = xSize <= EXACT_SUM_TERMS;
+        if (!exactSums)
+            std::cout << "Dot products of " << xSize << " terms round in float, compared with a wider tolerance" << std::endl;
+
+        std::vector<float> ref(y);
+        double start = omp_get_wtime();
+        for (size_t i = 0; i < iterations; i++) {
+            if (transposed)
+                host::gemvT(rows, cols, alpha, A.data(), x.data(), beta, ref.data());
+            else
+                host::gemv(rows, cols, alpha, A.data(), x.data(), beta, ref.data());
+        }
+        double end = omp_get_wtime();
+        const double seconds = (end - start) / iterations;
+        std::cout << "Open MP: " << seconds * 1e6 << " us, " << gemvBytes(rows, cols, transposed) / seconds * 1e-9 << " GB/s" << std::endl;
+
+        try {
+            std::vector<float> result;
+            computeGemvOnDevice(deviceType, kernelText, transposed, A, x, y, rows, cols, alpha, beta, iterations, result);
+            compare(ref, result, 0.01f, exactSums ? 1e-4f : 1e-3f);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+}
+
+// Small output, long K: computeOnDevice picks splitKGemm for optGemm, simpleGemm shows the single pass cost.
+// Entries in [-8, 8] keep every sum exact in float up to K = EXACT_SUM_TERMS, so the split and single pass
+// results must match exactly there. A longer K rounds differently per summation order and gets a tolerance.
+void computeSplitK(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int m, const unsigned int n,
+                   const unsigned int k, const uint64_t& seed) {
+    std::vector<float> in1(static_cast<size_t>(m) * k), in2(static_cast<size_t>(k) * n);
+    rng::fillUniformInt(in1.data(), 0, in1.size(), seed, -8, 8);
+    rng::fillUniformInt(in2.data(), 0, in2.size(), seed + 1, -8, 8);
+    std::vector<float> ref(static_cast<size_t>(m) * n);
+    const bool exactSums = k <= EXACT_SUM_TERMS;
+    if (!exactSums)
+        std::cout << "K = " << k << " sums round in float, compared with a relative tolerance" << std::endl;
+    std::cout << "Tiled GEMM work stealing" << std::endl;
+    computeTasks(in1.data(), in2.data(), ref.data(), k, m, n, k);
+
+    const char* kernelNames[2]{ "simpleGemm", "optGemm" };
+    for (size_t i = 0; i < 2; i++) {
+        std::cout << kernelNames[i] << " " << m << "x" << n << ", K = " << k << std::endl;
+        try {
+            std::vector<float> out;
+            computeOnDevice(deviceType, kernelText, kernelNames[i], in1, in2, out, k, m, n, k);
+            compare(ref, out, 0.01f, exactSums ? 0.0f : 1e-3f);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+}
+
+// GEMM variants placed on each roofline by their compulsory traffic; the tiled kernels should approach the compute roof
+void computeRoofline(const std::vector<char>& kernelText, const unsigned int size, const uint64_t& seed) {
+    const std::vector<float> in1 = getMatrix(size * size, seed);
+    const std::vector<float> in2 = getMatrix(size * size, seed + 1);
+    std::vector<float> out(static_cast<size_t>(size) * size);
+    const double flops = gemmFlops(size, size, size);
+    const double bytes = gemmBytes(size, size, size);
+    {
+        rooflinePeak host;
+        measureHostPeak(8, 1 << 25, host);
+        printPeak(host);
+        double start = omp_get_wtime();
+        computeOMP(in1.data(), in2.data(), out.data(), size, size, size, size);
+        double end = omp_get_wtime();
+        double tasksStart = omp_get_wtime();
+        computeTasks(in1.data(), in2.data(), out.data(), size, size, size, size);
+        double tasksEnd = omp_get_wtime();
+        printRoofline(host, { { "computeOMP", flops, bytes, end - start }, { "computeTasks", flops, bytes, tasksEnd - tasksStart } });
+    }
+
+    const cl_device_type deviceTypes[2]{ CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
+    const char* kernelNames[5]{ "slowSimpleGemm", "simpleGemm", "optGemm", "imageGemm", "blockedGemm" };
+    for (size_t i = 0; i < 2; i++) {
+        try {
+            deviceInfo info;
+            selectDevice(deviceTypes[i], info);
+            rooflinePeak peak;
+            measureDevicePeak(info, 1 << 25, peak);
+            printPeak(peak);
+            std::vector<rooflinePoint> points;
+            for (size_t k = 0; k < 5; k++) {
+                const bufferType bt = k == 3 ? bufferType::IMAGE : bufferType::BUFFER;
+                const double time = computeOnDevice(deviceTypes[i], kernelText, kernelNames[k], in1, in2, out, size, size, size, size, bt);
+                points.push_back({ kernelNames[k], flops, bytes, time });
+            }
+            printRoofline(peak, points);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+}
+
+// Samples every GEMM variant repeats times and appends the results to the store at path
+void recordBenchmarks(const std::vector<char>& kernelText, const unsigned int size, const size_t repeats, const uint64_t& seed,
+                      const std::string& path) {
+    const std::string revision = currentRevision();
+    const std::string timestamp = currentTimestamp();
+    const std::string shape = std::to_string(size) + "x" + std::to_string(size) + "x" + std::to_string(size);
+    const std::vector<float> in1 = getMatrix(size * size, seed);
+    const std::vector<float> in2 = getMatrix(size * size, seed + 1);
+    std::vector<float> out(static_cast<size_t>(size) * size);
+    std::vector<benchmarkResult> results;
+    {
+        benchmarkResult omp{ revision, timestamp, "host", "OpenMP " + std::to_string(_OPENMP), "computeOMP", shape, {} };
+        for (size_t r = 0; r < repeats; r++) {
+            double start = omp_get_wtime();
+            computeOMP(in1.data(), in2.data(), out.data(), size, size, size, size);
+            double end = omp_get_wtime();
+            omp.samples.push_back(end - start);
+        }
+        results.push_back(omp);
+        benchmarkResult tasks{ revision, timestamp, "host", "work stealing pool", "computeTasks", shape, {} };
+        for (size_t r = 0; r < repeats; r++) {
+            double start = omp_get_wtime();
+            computeTasks(in1.data(), in2.data(), out.data(), size, size, size, size);
+            double end = omp_get_wtime();
+            tasks.samples.push_back(end - start);
+        }
+        results.push_back(tasks);
+    }
+
+    const cl_device_type deviceTypes[2]{ CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
+    const char* kernelNames[5]{ "slowSimpleGemm", "simpleGemm", "optGemm", "imageGemm", "blockedGemm" };
+    for (size_t i = 0; i < 2; i++) {
+        try {
+            deviceInfo info;
+            selectDevice(deviceTypes[i], info);
+            std::vector<std::string> recorded;
+            for (size_t k = 0; k < 5; k++) {
+                bufferType bt = k == 3 ? bufferType::IMAGE : bufferType::BUFFER;
+                // variants are recorded under the kernel computeOnDevice actually runs on this device; a fallback
+                // to a kernel that is already recorded (imageGemm without image support) is skipped
+                bufferType selectedBt = bt;
+                const std::string kernelName = selectGemmLaunch(info, kernelNames[k], selectedBt, size, size, size, size, true).kernelName;
+                if (std::find(recorded.begin(), recorded.end(), kernelName) != recorded.end()) {
+                    std::cout << info.name << ": " << kernelNames[k] << " runs as " << kernelName << ", skipped" << std::endl;
+                    continue;
+                }
+                recorded.push_back(kernelName);
+                benchmarkResult gemm{ revision, timestamp, info.name, info.driverVersion, kernelName, shape, {} };
+                for (size_t r = 0; r < repeats; r++)
+                    gemm.samples.push_back(computeOnDevice(deviceTypes[i], kernelText, kernelNames[k], in1, in2, out, size, size, size, size, bt));
+                results.push_back(gemm);
+            }
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+    appendResults(path, results);
+    std::cout << results.size() << " results of " << revision << " appended to " << path << std::endl;
+}
+
+// Fills n elements with philoxMatrix on the device and with getMatrix on the host, the streams must be identical
+void computeGenerator(const cl_device_type deviceType, const std::vector<char>& kernelText, const unsigned int n, const uint64_t& seed) {
+    double start = omp_get_wtime();
+    const std::vector<float> ref = getMatrix(n, seed);
+    double end = omp_get_wtime();
+    std::cout << "Open MP generation time: " << (end - start) << std::endl;
+
+    deviceInfo info;
+    selectDevice(deviceType, info);
+    cl_context context{};
+    createContext(info.platform, info.device, context);
+    cl_command_queue queue{};
+    createQueue(context, info.device, queue);
+    cl_program program{};
+    cl_kernel generator{};
+    createProgramAndKernel(context, info.device, program, generator, kernelText, "philoxMatrix", "");
+    cl_mem buffer = createOutputBuffer(context, n);
+
+    start = omp_get_wtime();
+    generateMatrixOnDevice(queue, generator, buffer, n, seed, -100, 100);
+    if (clFinish(queue) != CL_SUCCESS)
+        throw std::runtime_error("Can't finish generator execution");
+    end = omp_get_wtime();
+    std::cout << info.name << " generation time: " << (end - start) << std::endl;
+
+    std::vector<float> out(n);
+    if (clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0, sizeof(float) * n, out.data(), 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't read from buffer");
+    compare(ref, out);
+
+    clReleaseMemObject(buffer);
+    clReleaseKernel(generator);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+// lab3 <a.npy> <b.npy> <c.npy> [gpu|cpu|omp|tasks]: C = A * B, all files memory mapped
+int runNpy(int argc, char* argv[]) {
+    try {
+        npyArray a, b, c;
+        openNpy(argv[1], a);
+        openNpy(argv[2], b);
+        if (a.shape.size() != 2 || b.shape.size() != 2 || a.shape[1] != b.shape[0])
+            throw std::runtime_error("Cant mult matrix");
+        if (a.shape[0] > INT_MAX || a.shape[1] > INT_MAX || b.shape[1] > INT_MAX)
+            throw std::runtime_error("Too large matrix for gemm");
+        const unsigned int row1 = static_cast<unsigned int>(a.shape[0]);
+        const unsigned int col1 = static_cast<unsigned int>(a.shape[1]);
+        const unsigned int row2 = static_cast<unsigned int>(b.shape[0]);
+        const unsigned int col2 = static_cast<unsigned int>(b.shape[1]);
+        createNpy<float>(argv[3], { row1, col2 }, c);
+        const std::string backend = argc > 4 ? argv[4] : "gpu";
+
+        if (backend == "omp") {
+            perfRegion("Open MP", 8, gemmBytes(col1, row1, col2), gemmFlops(col1, row1, col2),
+                       [&]() { computeOMP(npyData<float>(a), npyData<float>(b), npyData<float>(c), col1, row1, col2, row2); });
+        } else if (backend == "tasks") {
+            computeTasks(npyData<float>(a), npyData<float>(b), npyData<float>(c), col1, row1, col2, row2);
+        } else if (backend == "gpu" || backend == "cpu") {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            computeOnDevice(backend == "gpu" ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, kernelText, "optGemm",
+                            npyData<float>(a), npyData<float>(b), npyData<float>(c), col1, row1, col2, row2, bufferType::BUFFER, true);
+        } else {
+            throw std::runtime_error("Unknown backend " + backend);
+        }
+        closeNpy(a);
+        closeNpy(b);
+        closeNpy(c);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // lab3 --subdevices <numa|l3|equal:N|counts:N,M,...>: concurrent GEMM jobs on CPU sub-devices
+    if (argc > 2 && std::string(argv[1]) == "--subdevices") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            computeOnSubDevices(kernelText, argv[2], 512, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --executor <queues> [ooo] [gpu|cpu]: many small independent GEMMs over several queues
+    if (argc > 2 && std::string(argv[1]) == "--executor") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            bool outOfOrder = false;
+            cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+            for (int i = 3; i < argc; i++) {
+                outOfOrder = outOfOrder || std::string(argv[i]) == "ooo";
+                if (std::string(argv[i]) == "cpu")
+                    deviceType = CL_DEVICE_TYPE_CPU;
+            }
+            computeManySmall(deviceType, kernelText, 64, 128, 1, false, 1);
+            computeManySmall(deviceType, kernelText, 64, 128, std::stoul(argv[2]), outOfOrder, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --epilogue [gpu|cpu]: GEMM with fused alpha/beta, bias, activation, residual and half output
+    if (argc > 1 && std::string(argv[1]) == "--epilogue") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeEpilogues(deviceType, kernelText, 512, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --conv [gpu|cpu]: conv2d through im2col + GEMM and implicit GEMM against the Open MP reference
+    if (argc > 1 && std::string(argv[1]) == "--conv") {
+        try {
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeConvolutions(deviceType, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --roofline: STREAM bandwidth and peak FLOP/s per device, GEMM kernels placed on each roofline
+    if (argc > 1 && std::string(argv[1]) == "--roofline") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            computeRoofline(kernelText, 1024, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --record [repeats]: append timing samples of every variant to the results store ($LABS_RESULTS or lab3_results.csv)
+    if (argc > 1 && std::string(argv[1]) == "--record") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            recordBenchmarks(kernelText, 1024, argc > 2 ? std::stoul(argv[2]) : 10, 1, resultsPath("lab3_results.csv"));
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --compare <baseline> [candidate]: flag variants whose median time regressed against the baseline revision
+    if (argc > 2 && std::string(argv[1]) == "--compare")
+        return runCompare(argc, argv, resultsPath("lab3_results.csv"));
+    // lab3 --jit [gpu|cpu]: recurring shapes switch to shape specialized kernels
+    if (argc > 1 && std::string(argv[1]) == "--jit") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeRepeated(deviceType, kernelText, { { 256, 256, 256 }, { 512, 64, 128 }, { 100, 37, 300 } }, 200, 1, 2);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --splitk [gpu|cpu] [m] [n] [k]: small output with a long K, split across work-groups (64x64 and a ragged
+    // 100x100 with K = 2^18 - 3 by default)
+    if (argc > 1 && std::string(argv[1]) == "--splitk") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            const unsigned int m = argc > 3 ? static_cast<unsigned int>(std::stoul(argv[3])) : 64;
+            const unsigned int n = argc > 4 ? static_cast<unsigned int>(std::stoul(argv[4])) : 64;
+            const unsigned int k = argc > 5 ? static_cast<unsigned int>(std::stoul(argv[5])) : 1 << 18;
+            computeSplitK(deviceType, kernelText, m, n, k, 1);
+            // without a shape also a ragged one, rows, columns and K off the tile
+            if (argc <= 3)
+                computeSplitK(deviceType, kernelText, 100, 100, (1 << 18) - 3, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --gemv [gpu|cpu] [rows] [cols]: y = alpha * A * x + beta * y and A^T * x, repeated as in an iterative solver
+    if (argc > 1 && std::string(argv[1]) == "--gemv") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            const unsigned int rows = argc > 3 ? static_cast<unsigned int>(std::stoul(argv[3])) : 4096;
+            const unsigned int cols = argc > 4 ? static_cast<unsigned int>(std::stoul(argv[4])) : 4096;
+            computeGemv(deviceType, kernelText, rows, cols, 1000, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --dgemm [gpu|cpu] [size]: double precision GEMM kernels, host fallback without fp64
+    if (argc > 1 && std::string(argv[1]) == "--dgemm") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeDgemm(deviceType, kernelText, argc > 3 ? static_cast<unsigned int>(std::stoul(argv[3])) : 1024, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --lowmem [size] [gpu|cpu]: GEMM benchmark verified band by band, without reference or result copies
+    if (argc > 1 && std::string(argv[1]) == "--lowmem") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const unsigned int size = argc > 2 ? static_cast<unsigned int>(std::stoul(argv[2])) : 1024;
+            const cl_device_type deviceType = argc > 3 && std::string(argv[3]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeLowMemory(deviceType, kernelText, size, 64, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --hybrid [gpu|cpu] [deviceShare]: one GEMM split by rows between a device and the host work-stealing pool
+    if (argc > 1 && std::string(argv[1]) == "--hybrid") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeHybrid(deviceType, kernelText, 1024, argc > 3 ? std::stod(argv[3]) : 0.75, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    // lab3 --philox [gpu|cpu] [n]: device and host input generation produce the same matrix
+    if (argc > 1 && std::string(argv[1]) == "--philox") {
+        try {
+            std::vector<char> kernelText;
+            getKernelText(kernelText);
+            const cl_device_type deviceType = argc > 2 && std::string(argv[2]) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
+            computeGenerator(deviceType, kernelText, argc > 3 ? static_cast<unsigned int>(std::stoul(argv[3])) : 1 << 24, 1);
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 3)
+        return runNpy(argc, argv);
+
     const unsigned int col1 = 1024;
     const unsigned int row1 = 1024;
     const unsigned int col2 = 1024;
     const unsigned int row2 = 1024;
-    const std::vector<float> in1 = getMatrix(col1 * row1);
-    const std::vector<float> in2 = getMatrix(col2 * row2);
+    const uint64_t seed1 = 1;
+    const uint64_t seed2 = 2;
+    const std::vector<float> in1 = getMatrix(col1 * row1, seed1);
+    const std::vector<float> in2 = getMatrix(col2 * row2, seed2);
 
     //std::vector<float> ref = reference(in1, in2, col1, row1, col2, row2);
 
     try {
         cl_device_type deviceTypeGPU = CL_DEVICE_TYPE_GPU;
         cl_device_type deviceTypeCPU = CL_DEVICE_TYPE_CPU;
-        cl_platform_id platform{};
-        getPlatform(platform);
         std::vector<char> kernelText;
-        readKernelFile(kernelText);
-        kernelText.push_back(0);
+        getKernelText(kernelText);
 
         // Task 1
         // GPU
         {
             std::vector<float> out;
             std::cout << "Slow simple GEMM GPU" << std::endl;
-            computeOnDevice(platform, deviceTypeGPU, kernelText, "slowSimpleGemm", in1, in2, out, col1, row1, col2, row2);
+            computeOnDevice(deviceTypeGPU, kernelText, "slowSimpleGemm", in1, in2, out, col1, row1, col2, row2);
             //compare(ref, out);
         }
         {
             std::vector<float> out;
             std::cout << "Simple GEMM GPU" << std::endl;
-            computeOnDevice(platform, deviceTypeGPU, kernelText, "simpleGemm", in1, in2, out, col1, row1, col2, row2);
+            computeOnDevice(deviceTypeGPU, kernelText, "simpleGemm", in1, in2, out, col1, row1, col2, row2);
             //compare(ref, out);
         }
         // CPU
         {
             std::vector<float> out;
             std::cout << "Simple GEMM CPU" << std::endl;
-            computeOnDevice(platform, deviceTypeCPU, kernelText, "simpleGemm", in1, in2, out, col1, row1, col2, row2);
+            computeOnDevice(deviceTypeCPU, kernelText, "simpleGemm", in1, in2, out, col1, row1, col2, row2);
             //compare(ref, out);
         }
         std::cout << std::endl << std::endl;
         {
-            std::vector<float> out;
+            std::vector<float> out(row1 * col2);
             std::cout << "Simple GEMM Open MP" << std::endl;
-            computeOMP(in1, in2, out, col1, row1, col2, row2);
+            perfRegion("Open MP", 8, gemmBytes(col1, row1, col2), gemmFlops(col1, row1, col2),
+                       [&]() { computeOMP(in1.data(), in2.data(), out.data(), col1, row1, col2, row2); });
+            //compare(ref, out);
+        }
+        {
+            std::vector<float> out(row1 * col2);
+            std::cout << "Tiled GEMM work stealing" << std::endl;
+            computeTasks(in1.data(), in2.data(), out.data(), col1, row1, col2, row2);
             //compare(ref, out);
         }
         std::cout << std::endl << std::endl;
@@ -286,20 +1776,32 @@ int main() {
         {
             std::vector<float> out;
             std::cout << "Slow opt GEMM GPU" << std::endl;
-            computeOnDevice(platform, deviceTypeGPU, kernelText, "slowOptGemm", in1, in2, out, col1, row1, col2, row2);
+            computeOnDevice(deviceTypeGPU, kernelText, "slowOptGemm", in1, in2, out, col1, row1, col2, row2);
             //compare(ref, out);
         }
         {
             std::vector<float> out;
             std::cout << "Opt GEMM GPU" << std::endl;
-            computeOnDevice(platform, deviceTypeGPU, kernelText, "optGemm", in1, in2, out, col1, row1, col2, row2);
+            computeOnDevice(deviceTypeGPU, kernelText, "optGemm", in1, in2, out, col1, row1, col2, row2);
+            //compare(ref, out);
+        }
+        {
+            std::vector<float> out;
+            std::cout << "Blocked GEMM GPU" << std::endl;
+            computeOnDevice(deviceTypeGPU, kernelText, "blockedGemm", in1, in2, out, col1, row1, col2, row2);
             //compare(ref, out);
         }
         // CPU
         {
             std::vector<float> out;
             std::cout << "Opt GEMM CPU" << std::endl;
-            computeOnDevice(platform, deviceTypeCPU, kernelText, "optGemm", in1, in2, out, col1, row1, col2, row2);
+            computeOnDevice(deviceTypeCPU, kernelText, "optGemm", in1, in2, out, col1, row1, col2, row2);
+            //compare(ref, out);
+        }
+        {
+            std::vector<float> out;
+            std::cout << "Blocked GEMM CPU" << std::endl;
+            computeOnDevice(deviceTypeCPU, kernelText, "blockedGemm", in1, in2, out, col1, row1, col2, row2);
             //compare(ref, out);
         }
         std::cout << std::endl << std::endl;
@@ -309,14 +1811,14 @@ int main() {
         {
             std::vector<float> out;
             std::cout << "Image GEMM GPU" << std::endl;
-            computeOnDevice(platform, deviceTypeGPU, kernelText, "imageGemm", in1, in2, out, col1, row1, col2, row2, bufferType::IMAGE);
+            computeOnDevice(deviceTypeGPU, kernelText, "imageGemm", in1, in2, out, col1, row1, col2, row2, bufferType::IMAGE);
             //compare(ref, out);
         }
         // CPU
         {
             std::vector<float> out;
             std::cout << "Image GEMM CPU" << std::endl;
-            computeOnDevice(platform, deviceTypeCPU, kernelText, "imageGemm", in1, in2, out, col1, row1, col2, row2, bufferType::IMAGE);
+            computeOnDevice(deviceTypeCPU, kernelText, "imageGemm", in1, in2, out, col1, row1, col2, row2, bufferType::IMAGE);
             //compare(ref, out);
         }
         
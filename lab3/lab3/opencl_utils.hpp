@@ -4,58 +4,21 @@
 #include <stdexcept>
 #include <vector>
 #include <cstring>
-#include <fstream>
 #include <string>
 
-void getPlatform(cl_platform_id& platform) {
-    cl_uint numPlatforms = 0;
-    if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number platforms");
-
-    std::vector<cl_platform_id> platforms(numPlatforms);
-    if (clGetPlatformIDs(numPlatforms, platforms.data(), NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get platforms");
-
-    for (cl_uint i = 0; i < numPlatforms; i++) {
-        const size_t paramValueSize = 100;
-        size_t parValRetSize = 0;
-        char name[paramValueSize];
-        if (clGetPlatformInfo(platforms[i], CL_PLATFORM_NAME, paramValueSize, name, &parValRetSize) != CL_SUCCESS)
-            throw std::runtime_error("Can't get platforms info");
-        name[parValRetSize] = '\0';
-        if (strstr(name, "Intel") != nullptr) {
-            platform = platforms[i];
-            return;
-        }
-    }
+#include "random_utils.hpp"
+#include "device_info.hpp"
+#include "program_cache.hpp"
+#include "kernels_cl.hpp"
+#include "conv_cl.hpp"
 
-    throw std::runtime_error("Can't find Intel platform");
+// kernels.cl is compiled into the binary (kernels_cl.hpp, regenerate with tools/embed_cl.py), the text keeps its terminating null
+void getKernelText(std::vector<char>& kernelText) {
+    kernelText.assign(kernelsSource, kernelsSource + sizeof(kernelsSource));
 }
 
-void readKernelFile(std::vector<char>& kernelText) {
-    std::ifstream desc("kernels.cl", std::ios_base::ate | std::ios_base::binary);
-    std::streamoff fileSize = desc.tellg();
-    if (fileSize == -1)
-        throw std::runtime_error("Can't read kernel file");
-
-    desc.seekg(0, std::ios_base::beg);
-    kernelText.resize(fileSize);
-    desc.read(&kernelText[0], fileSize);
-}
-
-void getDevice(const cl_platform_id& platform, const cl_device_type& dt, cl_device_id& device) {
-    cl_uint numDevices = 0;
-    if (clGetDeviceIDs(platform, dt, 0, NULL, &numDevices) != CL_SUCCESS)
-        throw std::runtime_error("Can't get number devices");
-    if (numDevices > 1)
-        throw std::runtime_error("Unsupport more than one device");
-
-    if (clGetDeviceIDs(platform, dt, numDevices, &device, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get devices");
-    /*size_t ret = 0;
-    if (clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(ret), &ret, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't get devices CL_DEVICE_MAX_WORK_GROUP_SIZE");
-    std::cout << "CL_DEVICE_MAX_WORK_GROUP_SIZE: " << ret << std::endl;*/
+void getConvKernelText(std::vector<char>& kernelText) {
+    kernelText.assign(convSource, convSource + sizeof(convSource));
 }
 
 void createContext(const cl_platform_id& platform, const cl_device_id& device, cl_context& context) {
@@ -66,6 +29,70 @@ void createContext(const cl_platform_id& platform, const cl_device_id& device, c
         throw std::runtime_error("Can't create context");
 }
 
+enum partitionType {
+    EQUALLY,
+    BY_COUNTS,
+    BY_AFFINITY_NUMA,
+    BY_AFFINITY_L3
+};
+
+// "numa", "l3", "equal:<units>" or "counts:<units>,<units>,..."
+void parsePartition(const std::string& spec, partitionType& pt, std::vector<cl_uint>& counts) {
+    counts.clear();
+    if (spec == "numa") {
+        pt = partitionType::BY_AFFINITY_NUMA;
+    } else if (spec == "l3") {
+        pt = partitionType::BY_AFFINITY_L3;
+    } else if (spec.compare(0, 6, "equal:") == 0) {
+        pt = partitionType::EQUALLY;
+        counts.push_back(static_cast<cl_uint>(std::stoul(spec.substr(6))));
+    } else if (spec.compare(0, 7, "counts:") == 0) {
+        pt = partitionType::BY_COUNTS;
+        for (size_t pos = 7; pos < spec.size();) {
+            size_t next = spec.find(',', pos);
+            if (next == std::string::npos)
+                next = spec.size();
+            counts.push_back(static_cast<cl_uint>(std::stoul(spec.substr(pos, next - pos))));
+            pos = next + 1;
+        }
+    } else {
+        throw std::runtime_error("Unknown partition " + spec);
+    }
+}
+
+// counts holds compute units per sub-device (one value for EQUALLY)
+void createSubDevices(const cl_device_id& device, const partitionType pt, const std::vector<cl_uint>& counts, std::vector<cl_device_id>& subDevices) {
+    std::vector<cl_device_partition_property> props;
+    if (pt == partitionType::EQUALLY) {
+        if (counts.size() != 1)
+            throw std::runtime_error("Equally partition needs one count");
+        props = { CL_DEVICE_PARTITION_EQUALLY, static_cast<cl_device_partition_property>(counts[0]), 0 };
+    } else if (pt == partitionType::BY_COUNTS) {
+        props.push_back(CL_DEVICE_PARTITION_BY_COUNTS);
+        for (size_t i = 0; i < counts.size(); i++)
+            props.push_back(static_cast<cl_device_partition_property>(counts[i]));
+        props.push_back(CL_DEVICE_PARTITION_BY_COUNTS_LIST_END);
+        props.push_back(0);
+    } else {
+        const cl_device_affinity_domain domain = pt == partitionType::BY_AFFINITY_NUMA ? CL_DEVICE_AFFINITY_DOMAIN_NUMA : CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE;
+        props = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, static_cast<cl_device_partition_property>(domain), 0 };
+    }
+
+    cl_uint numSubDevices = 0;
+    cl_int retCode = clCreateSubDevices(device, props.data(), 0, NULL, &numSubDevices);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't partition device: " + std::to_string(retCode));
+    subDevices.resize(numSubDevices);
+    if (clCreateSubDevices(device, props.data(), numSubDevices, subDevices.data(), NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't create sub devices");
+}
+
+void releaseSubDevices(std::vector<cl_device_id>& subDevices) {
+    for (size_t i = 0; i < subDevices.size(); i++)
+        clReleaseDevice(subDevices[i]);
+    subDevices.clear();
+}
+
 void createQueue(const cl_context& context, const cl_device_id& device, cl_command_queue& queue) {
     cl_int retCode = 0;
     queue = clCreateCommandQueueWithProperties(context, device, NULL, &retCode);
@@ -74,31 +101,61 @@ void createQueue(const cl_context& context, const cl_device_id& device, cl_comma
 }
 
 void createProgramAndKernel(const cl_context& context, const cl_device_id& device, cl_program& program, cl_kernel& kernel,
-                            const std::vector<char>& kernelText, const std::string kernelName) {
-    const char* rawKernelText = &kernelText[0];
+                            const std::vector<char>& kernelText, const std::string kernelName, const std::string options = "") {
+    buildProgram(context, device, kernelText, options, program);
 
     cl_int retCode;
-    program = clCreateProgramWithSource(context, 1, &rawKernelText, 0, &retCode);
-    if (retCode != CL_SUCCESS)
-        throw std::runtime_error("Can't create program with source");
-    if (clBuildProgram(program, 1, &device, NULL, NULL, NULL) != CL_SUCCESS)
-        throw std::runtime_error("Can't build program");
-
     kernel = clCreateKernel(program, kernelName.c_str(), &retCode);
     if (retCode != CL_SUCCESS)
         throw std::runtime_error("Can't create kernel");
 }
 
-void compare(const std::vector<float>& res1, const std::vector<float>& res2) {
+// Elements may differ by tolerance plus relTolerance of the res1 magnitude; offset only shifts the reported index.
+// Returns false after printing the first difference.
+template <typename dataType>
+bool compareRange(const dataType* res1, const dataType* res2, const size_t count, const size_t offset = 0,
+                  const float tolerance = 0.01f, const float relTolerance = 0.0f) {
+    for (size_t i = 0; i < count; i++) {
+        // written so a NaN on either side is a mismatch
+        if (!(std::abs(res1[i] - res2[i]) <= tolerance + relTolerance * std::abs(res1[i]))) {
+            std::cout << "Different result on res1: " << res1[i] << " and res2: " << res2[i] << " on idx: " << offset + i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void compare(const std::vector<float>& res1, const std::vector<float>& res2, const float tolerance = 0.01f, const float relTolerance = 0.0f) {
     if (res1.size() != res2.size()) {
         std::cout << "Vectors have different size" << std::endl;
         return;
     }
-    for (size_t i = 0; i < res1.size(); i++) {
-        if (std::abs(res1[i] - res2[i]) > 0.01f) {
-            std::cout << "Different result on res1: " << res1[i] << " and res2: " << res2[i] << " on idx: " << i << std::endl;
-            return;
-        }
-    }
+    compareRange(res1.data(), res2.data(), res1.size(), 0, tolerance, relTolerance);
 }
 
+void setMatrixGeneratorArguments(const cl_kernel& generator, const cl_mem& buffer, const unsigned int n,
+                                 const uint64_t& seed, const int lo, const int hi) {
+    const cl_uint seedLo = static_cast<cl_uint>(seed);
+    const cl_uint seedHi = static_cast<cl_uint>(seed >> 32);
+    if (clSetKernelArg(generator, 0, sizeof(cl_mem), &buffer) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 0 generator arg");
+    if (clSetKernelArg(generator, 1, sizeof(unsigned int), &n) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 1 generator arg");
+    if (clSetKernelArg(generator, 2, sizeof(cl_uint), &seedLo) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 2 generator arg");
+    if (clSetKernelArg(generator, 3, sizeof(cl_uint), &seedHi) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 3 generator arg");
+    if (clSetKernelArg(generator, 4, sizeof(int), &lo) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 4 generator arg");
+    if (clSetKernelArg(generator, 5, sizeof(int), &hi) != CL_SUCCESS)
+        throw std::runtime_error("Can't set 5 generator arg");
+}
+
+// Fills the first n elements of buffer on the device with the rng stream of seed (same values as rng::fillUniformInt)
+void generateMatrixOnDevice(const cl_command_queue& queue, const cl_kernel& generator, const cl_mem& buffer, const unsigned int n,
+                            const uint64_t& seed, const int lo, const int hi) {
+    setMatrixGeneratorArguments(generator, buffer, n, seed, lo, hi);
+    const size_t globalWorkSize = (n + 3) / 4;
+    if (clEnqueueNDRangeKernel(queue, generator, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL) != CL_SUCCESS)
+        throw std::runtime_error("Can't run generator execution");
+}
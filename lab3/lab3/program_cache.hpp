@@ -0,0 +1,135 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "device_info.hpp"
+
+// On-disk cache of device binaries (CL_PROGRAM_BINARIES). Entries are keyed by device name, driver
+// version, build options and source, so a driver update or kernel edit simply misses the cache.
+// The directory is $OPENCL_PROGRAM_CACHE, else $XDG_CACHE_HOME/labs-opencl, else ~/.cache/labs-opencl.
+
+uint64_t fnv1a(const std::string& data, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < data.size(); i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string programCacheDir() {
+    if (const char* dir = std::getenv("OPENCL_PROGRAM_CACHE"))
+        return dir;
+    if (const char* dir = std::getenv("XDG_CACHE_HOME"))
+        return std::string(dir) + "/labs-opencl";
+    if (const char* dir = std::getenv("HOME"))
+        return std::string(dir) + "/.cache/labs-opencl";
+    return "";
+}
+
+std::string programCachePath(const cl_device_id& device, const std::vector<char>& kernelText, const std::string& options) {
+    const std::string dir = programCacheDir();
+    if (dir.empty())
+        return "";
+    const std::string key = getDeviceString(device, CL_DEVICE_NAME) + "\n" + getDeviceString(device, CL_DRIVER_VERSION) + "\n" + options + "\n" +
+                            std::string(kernelText.begin(), kernelText.end());
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(fnv1a(key)));
+    return dir + "/" + name;
+}
+
+void makeDirs(const std::string& dir) {
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+        if (pos == std::string::npos)
+            break;
+    }
+}
+
+std::string buildLog(const cl_program& program, const cl_device_id& device) {
+    size_t size = 0;
+    if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &size) != CL_SUCCESS)
+        return "";
+    std::string log(size, '\0');
+    if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, &log[0], NULL) != CL_SUCCESS)
+        return "";
+    return log;
+}
+
+bool loadProgramBinary(const cl_context& context, const cl_device_id& device, const std::string& path, const std::string& options, cl_program& program) {
+    std::ifstream desc(path, std::ios_base::ate | std::ios_base::binary);
+    std::streamoff fileSize = desc.tellg();
+    if (fileSize <= 0)
+        return false;
+    desc.seekg(0, std::ios_base::beg);
+    std::vector<unsigned char> binary(static_cast<size_t>(fileSize));
+    if (!desc.read(reinterpret_cast<char*>(binary.data()), fileSize))
+        return false;
+
+    const unsigned char* rawBinary = binary.data();
+    const size_t binarySize = binary.size();
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int retCode = CL_SUCCESS;
+    program = clCreateProgramWithBinary(context, 1, &device, &binarySize, &rawBinary, &binaryStatus, &retCode);
+    if (retCode != CL_SUCCESS)
+        return false;
+    // a stale or foreign binary can still yield a program object, it is dropped before the source build
+    if (binaryStatus != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return false;
+    }
+    if (clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return false;
+    }
+    return true;
+}
+
+void saveProgramBinary(const cl_program& program, const std::string& path) {
+    size_t binarySize = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, NULL) != CL_SUCCESS || binarySize == 0)
+        return;
+    std::vector<unsigned char> binary(binarySize);
+    unsigned char* rawBinary = binary.data();
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &rawBinary, NULL) != CL_SUCCESS)
+        return;
+
+    // written aside and renamed, so concurrent runs never see a partial file
+    makeDirs(path.substr(0, path.rfind('/')));
+    const std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    std::ofstream desc(tmpPath, std::ios_base::binary);
+    desc.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+    desc.close();
+    if (!desc || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        std::remove(tmpPath.c_str());
+}
+
+// kernelText must be null terminated. Loads the cached binary if there is one, otherwise compiles
+// the source and stores the resulting binary for the next run.
+void buildProgram(const cl_context& context, const cl_device_id& device, const std::vector<char>& kernelText, const std::string& options,
+                  cl_program& program) {
+    const std::string path = programCachePath(device, kernelText, options);
+    if (!path.empty() && loadProgramBinary(context, device, path, options, program))
+        return;
+
+    const char* rawKernelText = &kernelText[0];
+    cl_int retCode;
+    program = clCreateProgramWithSource(context, 1, &rawKernelText, 0, &retCode);
+    if (retCode != CL_SUCCESS)
+        throw std::runtime_error("Can't create program with source");
+    if (clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL) != CL_SUCCESS) {
+        const std::string log = buildLog(program, device);
+        clReleaseProgram(program);
+        throw std::runtime_error("Can't build program\n" + log);
+    }
+    if (!path.empty())
+        saveProgramBinary(program, path);
+}
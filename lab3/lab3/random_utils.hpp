@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <omp.h>
+
+// Counter-based Philox4x32-10 generator. Element i of a stream depends only on (seed, i),
+// so any range can be filled in parallel (or on the device) and reproduces the same stream.
+
+namespace rng {
+
+const uint32_t PHILOX_M0 = 0xD2511F53u;
+const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+const uint32_t PHILOX_W0 = 0x9E3779B9u;
+const uint32_t PHILOX_W1 = 0xBB67AE85u;
+
+inline void philox4x32(const uint64_t& block, const uint64_t& seed, uint32_t out[4]) {
+    uint32_t c0 = static_cast<uint32_t>(block), c1 = static_cast<uint32_t>(block >> 32), c2 = 0, c3 = 0;
+    uint32_t k0 = static_cast<uint32_t>(seed), k1 = static_cast<uint32_t>(seed >> 32);
+    for (int round = 0; round < 10; round++) {
+        const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0;
+        const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2;
+        const uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+        const uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// The philox* kernels produce the same integer stream. toUniformInt gives the same values there; the float
+// and double mappings agree up to rounding, as either compiler may contract lo + (hi - lo) * u into an fma.
+inline float toUniform(const uint32_t& r, const float& lo, const float& hi) {
+    const float u = static_cast<float>(r >> 8) * (1.0f / 16777216.0f);
+    return lo + (hi - lo) * u;
+}
+
+inline double toUniform(const uint32_t& r0, const uint32_t& r1, const double& lo, const double& hi) {
+    const double u = (static_cast<double>(r0 >> 5) * 67108864.0 + static_cast<double>(r1 >> 6)) * (1.0 / 9007199254740992.0);
+    return lo + (hi - lo) * u;
+}
+
+inline int toUniformInt(const uint32_t& r, const int& lo, const int& hi) {
+    const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(hi) - lo + 1);
+    return lo + static_cast<int>((static_cast<uint64_t>(r) * range) >> 32);
+}
+
+// Fills data[0, size) with elements [offset, offset + size) of the stream selected by seed.
+inline void fillUniform(float* data, const size_t& offset, const size_t& size, const uint64_t& seed, const float& lo, const float& hi) {
+    const long long firstBlock = static_cast<long long>(offset / 4);
+    const long long endBlock = static_cast<long long>((offset + size + 3) / 4);
+#pragma omp parallel for schedule(static)
+    for (long long b = firstBlock; b < endBlock; b++) {
+        uint32_t r[4];
+        philox4x32(static_cast<uint64_t>(b), seed, r);
+        for (size_t lane = 0; lane < 4; lane++) {
+            const size_t idx = static_cast<size_t>(b) * 4 + lane;
+            if (idx >= offset && idx < offset + size)
+                data[idx - offset] = toUniform(r[lane], lo, hi);
+        }
+    }
+}
+
+inline void fillUniform(double* data, const size_t& offset, const size_t& size, const uint64_t& seed, const double& lo, const double& hi) {
+    const long long firstBlock = static_cast<long long>(offset / 2);
+    const long long endBlock = static_cast<long long>((offset + size + 1) / 2);
+#pragma omp parallel for schedule(static)
+    for (long long b = firstBlock; b < endBlock; b++) {
+        uint32_t r[4];
+        philox4x32(static_cast<uint64_t>(b), seed, r);
+        for (size_t lane = 0; lane < 2; lane++) {
+            const size_t idx = static_cast<size_t>(b) * 2 + lane;
+            if (idx >= offset && idx < offset + size)
+                data[idx - offset] = toUniform(r[2 * lane], r[2 * lane + 1], lo, hi);
+        }
+    }
+}
+
+// Element idx of the stream alone, for sparse (strided) accesses that don't justify filling a range
+inline float uniformAt(const size_t& idx, const uint64_t& seed, const float& lo, const float& hi) {
+    uint32_t r[4];
+    philox4x32(static_cast<uint64_t>(idx / 4), seed, r);
+    return toUniform(r[idx % 4], lo, hi);
+}
+
+inline double uniformAt(const size_t& idx, const uint64_t& seed, const double& lo, const double& hi) {
+    uint32_t r[4];
+    philox4x32(static_cast<uint64_t>(idx / 2), seed, r);
+    return toUniform(r[2 * (idx % 2)], r[2 * (idx % 2) + 1], lo, hi);
+}
+
+// Integer values in [lo, hi] stored as float (matrices of lab3 use whole numbers to keep sums exact).
+inline void fillUniformInt(float* data, const size_t& offset, const size_t& size, const uint64_t& seed, const int& lo, const int& hi) {
+    const long long firstBlock = static_cast<long long>(offset / 4);
+    const long long endBlock = static_cast<long long>((offset + size + 3) / 4);
+#pragma omp parallel for schedule(static)
+    for (long long b = firstBlock; b < endBlock; b++) {
+        uint32_t r[4];
+        philox4x32(static_cast<uint64_t>(b), seed, r);
+        for (size_t lane = 0; lane < 4; lane++) {
+            const size_t idx = static_cast<size_t>(b) * 4 + lane;
+            if (idx >= offset && idx < offset + size)
+                data[idx - offset] = static_cast<float>(toUniformInt(r[lane], lo, hi));
+        }
+    }
+}
+
+}
@@ -0,0 +1,47 @@
+// STREAM kernels (copy, scale, add, triad) and a peak FLOP kernel for the roofline report (roofline.hpp)
+
+__kernel void streamCopy(__global const float *a, __global float *c, const unsigned int n) {
+    const unsigned int i = get_global_id(0);
+    if (i < n)
+        c[i] = a[i];
+}
+
+__kernel void streamScale(__global float *b, __global const float *c, const float q, const unsigned int n) {
+    const unsigned int i = get_global_id(0);
+    if (i < n)
+        b[i] = q * c[i];
+}
+
+__kernel void streamAdd(__global const float *a, __global const float *b, __global float *c, const unsigned int n) {
+    const unsigned int i = get_global_id(0);
+    if (i < n)
+        c[i] = a[i] + b[i];
+}
+
+__kernel void streamTriad(__global float *a, __global const float *b, __global const float *c, const float q, const unsigned int n) {
+    const unsigned int i = get_global_id(0);
+    if (i < n)
+        a[i] = b[i] + q * c[i];
+}
+
+// 8 independent float4 mad chains, 64 FLOP per iteration and work-item; the sum is stored so nothing is dead code
+__kernel void peakFlops(__global float *out, const int iterations, const float m) {
+    const float s = (float)get_global_id(0);
+    float4 x0 = s + (float4)(0.0f, 1.0f, 2.0f, 3.0f);
+    float4 x1 = x0 + 4.0f, x2 = x0 + 8.0f, x3 = x0 + 12.0f;
+    float4 x4 = x0 + 16.0f, x5 = x0 + 20.0f, x6 = x0 + 24.0f, x7 = x0 + 28.0f;
+    const float4 mv = (float4)(m);
+    const float4 c = (float4)(1.0f - m);
+    for (int i = 0; i < iterations; i++) {
+        x0 = mad(x0, mv, c);
+        x1 = mad(x1, mv, c);
+        x2 = mad(x2, mv, c);
+        x3 = mad(x3, mv, c);
+        x4 = mad(x4, mv, c);
+        x5 = mad(x5, mv, c);
+        x6 = mad(x6, mv, c);
+        x7 = mad(x7, mv, c);
+    }
+    const float4 sum = x0 + x1 + x2 + x3 + x4 + x5 + x6 + x7;
+    out[get_global_id(0)] = sum.x + sum.y + sum.z + sum.w;
+}
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""Embeds an OpenCL source file into a C++ header as a string constant.
+
+Usage: embed_cl.py <input.cl> <output.hpp> <symbol>
+
+Run it as a pre-build step whenever a .cl file changes (the generated headers are
+committed, so a plain checkout builds without it):
+    python3 tools/embed_cl.py lab2/lab2/axpy.cl lab2/lab2/axpy_cl.hpp axpySource
+    python3 tools/embed_cl.py lab3/lab3/kernels.cl lab3/lab3/kernels_cl.hpp kernelsSource
+"""
+import os
+import sys
+
+# MSVC limits a single string literal to 16 KB, so the source is split into several
+CHUNK_SIZE = 8000
+DELIMITER = "CLSRC"
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    source_path, header_path, symbol = sys.argv[1:]
+    with open(source_path, "r", newline="") as source_file:
+        source = source_file.read()
+    if ")" + DELIMITER + '"' in source:
+        sys.exit("source contains the raw string delimiter")
+
+    chunks = []
+    current = ""
+    for line in source.splitlines(keepends=True):
+        if current and len(current) + len(line) > CHUNK_SIZE:
+            chunks.append(current)
+            current = ""
+        current += line
+    chunks.append(current)
+
+    name = os.path.basename(source_path)
+    with open(header_path, "w", newline="\n") as header:
+        header.write("// Generated by tools/embed_cl.py from %s, do not edit\n" % name)
+        header.write("#pragma once\n\n")
+        header.write("const char %s[] =\n" % symbol)
+        for i, chunk in enumerate(chunks):
+            end = ";" if i + 1 == len(chunks) else ""
+            header.write('R"%s(%s)%s"%s\n' % (DELIMITER, chunk, DELIMITER, end))
+
+
+if __name__ == "__main__":
+    main()